@@ -0,0 +1,210 @@
+#pragma once
+
+#include "Random.h"
+#include "MathUtils.h"
+
+// Candidate sources that can be given to the generators instead of white noise (RNGContinuous).
+// They all have the same interface: operator() returns the next candidate in [0,1)^2.
+// White noise candidates clump together, which wastes trials. These spread out more evenly.
+
+namespace CandidateSources
+{
+    // The R2 sequence from http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+    // with a random toroidal shift so that each realization is different.
+    class R2
+    {
+    public:
+        R2(uint64_t seed = GetSeed())
+        {
+            pcg32_random_t rng;
+            pcg32_srandom_r(&rng, seed, 0);
+            m_value[0] = RandomFloat01(rng);
+            m_value[1] = RandomFloat01(rng);
+        }
+
+        Vec2 operator()()
+        {
+            // the golden ratio generalized to 2D: g^3 = g + 1
+            static const double c_g = 1.32471795724474602596;
+            static const double c_a1 = 1.0 / c_g;
+            static const double c_a2 = 1.0 / (c_g * c_g);
+
+            // accumulating in double keeps the sequence accurate for millions of candidates
+            Vec2 ret = Vec2{ float(m_value[0]), float(m_value[1]) };
+            m_value[0] += c_a1;
+            m_value[1] += c_a2;
+            m_value[0] -= std::floor(m_value[0]);
+            m_value[1] -= std::floor(m_value[1]);
+
+            // rounding to float can give 1.0
+            ret[0] = std::min(ret[0], 0.99999994f);
+            ret[1] = std::min(ret[1], 0.99999994f);
+            return ret;
+        }
+
+    private:
+        double m_value[2];
+    };
+
+    inline uint32_t ReverseBits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Hash based Owen scrambling, from "Practical Hash-based Owen Scrambling" (Burley 2020).
+    // Works on bit reversed values, where each output bit only depends on the lower bits, which is the
+    // nested uniform scramble property.
+    inline uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed)
+    {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1u;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+    }
+
+    // 2D Sobol, Owen scrambled. The index is scrambled too, so the sequence order is random
+    // while still keeping each power of 2 sized prefix well stratified.
+    class ScrambledSobol
+    {
+    public:
+        ScrambledSobol(uint64_t seed = GetSeed())
+        {
+            pcg32_random_t rng;
+            pcg32_srandom_r(&rng, seed, 0);
+            m_indexSeed = pcg32_random_r(&rng);
+            m_seeds[0] = pcg32_random_r(&rng);
+            m_seeds[1] = pcg32_random_r(&rng);
+        }
+
+        Vec2 operator()()
+        {
+            uint32_t index = NestedUniformScramble(m_index++, m_indexSeed);
+
+            // dimension 0 is the van der Corput sequence
+            uint32_t x = ReverseBits(index);
+
+            // dimension 1 uses the primitive polynomial x + 1
+            uint32_t y = 0;
+            uint32_t direction = 1u << 31;
+            for (uint32_t bits = index; bits != 0; bits >>= 1)
+            {
+                if (bits & 1)
+                    y ^= direction;
+                direction ^= direction >> 1;
+            }
+
+            x = NestedUniformScramble(x, m_seeds[0]);
+            y = NestedUniformScramble(y, m_seeds[1]);
+
+            // only keep the 24 bits that a float can hold, so we never round up to 1.0
+            return Vec2
+            {
+                float(x >> 8) / 16777216.0f,
+                float(y >> 8) / 16777216.0f
+            };
+        }
+
+    private:
+        uint32_t m_index = 0;
+        uint32_t m_indexSeed = 0;
+        uint32_t m_seeds[2] = {};
+    };
+
+    // A jittered grid that gets finer as it goes. Level L has 2^L x 2^L cells, which are visited in a
+    // random order, one jittered candidate each. When all cells are used, it moves to the next level.
+    class JitteredGrid
+    {
+    public:
+        JitteredGrid(uint64_t seed = GetSeed())
+        {
+            pcg32_srandom_r(&m_rng, seed, 0);
+            StartLevel(0);
+        }
+
+        Vec2 operator()()
+        {
+            if (m_cellIndex == (1ull << (2 * m_level)))
+                StartLevel(m_level + 1);
+
+            uint32_t cell = Shuffle(uint32_t(m_cellIndex++));
+            uint32_t cellsPerAxis = 1u << m_level;
+            uint32_t cellX = cell % cellsPerAxis;
+            uint32_t cellY = cell / cellsPerAxis;
+
+            Vec2 ret = Vec2
+            {
+                (float(cellX) + RandomFloat01(m_rng)) / float(cellsPerAxis),
+                (float(cellY) + RandomFloat01(m_rng)) / float(cellsPerAxis)
+            };
+            ret[0] = std::min(ret[0], 0.99999994f);
+            ret[1] = std::min(ret[1], 0.99999994f);
+            return ret;
+        }
+
+    private:
+        void StartLevel(int level)
+        {
+            // past 2^15 x 2^15 cells the cells are smaller than float precision anyways
+            m_level = std::min(level, 15);
+            m_cellIndex = 0;
+            m_shuffleSeed = pcg32_random_r(&m_rng) | 1u;
+            m_shuffleSeed2 = pcg32_random_r(&m_rng);
+        }
+
+        // A random permutation of [0, 4^level) without storing it.
+        // Every step is a bijection on the low 2*level bits.
+        uint32_t Shuffle(uint32_t x) const
+        {
+            if (m_level == 0)
+                return 0;
+
+            uint32_t bits = 2 * m_level;
+            uint32_t mask = (bits == 32) ? 0xFFFFFFFFu : ((1u << bits) - 1u);
+            uint32_t shift = std::max(bits / 2, 1u);
+            for (int round = 0; round < 3; ++round)
+            {
+                x = (x * m_shuffleSeed) & mask;
+                x ^= x >> shift;
+                x = (x + m_shuffleSeed2) & mask;
+            }
+            return x;
+        }
+
+        pcg32_random_t m_rng;
+        int m_level = 0;
+        uint64_t m_cellIndex = 0;
+        uint32_t m_shuffleSeed = 1;
+        uint32_t m_shuffleSeed2 = 0;
+    };
+
+    // Wraps a candidate source and counts how many candidates were taken from it
+    template <typename T>
+    class Counting
+    {
+    public:
+        Counting(T& source) : m_source(source) {}
+
+        Vec2 operator()()
+        {
+            m_count++;
+            return m_source();
+        }
+
+        uint64_t Count() const { return m_count; }
+
+    private:
+        T& m_source;
+        uint64_t m_count = 0;
+    };
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <vector>
+
+#include "Grid.h"
+#include "Hard.h"
+
+// Multi class corner tiles, for making non periodic point sets of any size without any more sampling.
+// Every corner of the tiling lattice gets one of colorCount colors, and there is a tile for each combination of the
+// 4 corner colors of a tile, so any random coloring can be tiled, one tile at a time.
+//
+// Around each lattice corner is a square with half size a that belongs to the corner, and around each edge between
+// corners is a band with half width b that belongs to the edge. Their points are made once for each corner color,
+// and each pair of corner colors for edges, and are shared by every tile that touches them. The rest of a tile is
+// its interior. Points are made by dart throwing using Hard's layers, r matrix and conflict checks, against the points
+// that are already made nearby: edges against their 2 corners, and interiors against their 4 corners and 4 edges.
+// With b = r / 2 and a = b + r / sqrt(2), for the largest radius r, regions that can end up next to each other in
+// different tilings are far enough apart that they can't conflict, so any tiling satisfies the r matrix everywhere.
+//
+// Radii are in units of tiles, and must be at most 1/3.5 so that corner squares don't get too close to each other.
+// Points that fail to fit after enough tries are skipped, like Hard::Make gives up, but there is no point removal.
+
+namespace CornerTiles
+{
+    struct TileSet
+    {
+        int colorCount = 0;
+
+        // tiles[TileIndex()], with points in [0,1)^2
+        std::vector<std::vector<Point>> tiles;
+
+        // the corners are at (0,0), (1,0), (0,1) and (1,1)
+        int TileIndex(int c00, int c10, int c01, int c11) const
+        {
+            return ((c00 * colorCount + c10) * colorCount + c01) * colorCount + c11;
+        }
+    };
+
+    template <size_t N, typename RNG>
+    TileSet Make(const float(&radii)[N], int targetCount, int colorCount, RNG& rng)
+    {
+        TileSet ret;
+
+        std::vector<Hard::Layer> layers = Hard::MakeLayers(radii, targetCount);
+        std::array<std::array<float, N>, N> rMatrix = Hard::MakeRMatrix<N>(layers);
+
+        float maxRadius = layers[0].radius;
+        if (maxRadius > 1.0f / 3.5f)
+        {
+            printf("CornerTiles::Make(): radius %f is too large for a tile. It needs to be at most %f.\n", maxRadius, 1.0f / 3.5f);
+            return ret;
+        }
+        float b = maxRadius * 0.5f;
+        float a = b + maxRadius / std::sqrt(2.0f);
+
+        // Points are made in tile space, which is [-0.5, 1.5) here, and the grids are over that, so the
+        // grids see (x + 0.5) / 2, and distances are halved.
+        std::array<std::array<float, N>, N> gridRMatrix;
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+                gridRMatrix[i][j] = rMatrix[i][j] * 0.5f;
+        }
+        auto ToGrid = [](const Vec2& v)
+        {
+            return Vec2{ (v[0] + 0.5f) * 0.5f, (v[1] + 0.5f) * 0.5f };
+        };
+
+        // Throws darts in the rectangle from rectMin to rectMax, skipping points where excluded(point) is true.
+        // existing is the points they have to fit around, in tile space. area is the area of the region that
+        // isn't excluded, and decides how many points of each class to try and make.
+        std::vector<Point> workPoints;
+        std::vector<int> conflicts;
+        auto Fill = [&](const Vec2& rectMin, const Vec2& rectMax, float area, const std::vector<Point>& existing, const auto& excluded)
+        {
+            std::vector<Grid<100, 100>> grids(N);
+            workPoints = existing;
+            for (int i = 0; i < (int)workPoints.size(); ++i)
+            {
+                Vec2 gridPoint = ToGrid(workPoints[i].v);
+                grids[workPoints[i].classIndex].AddPoint(i, gridPoint[0], gridPoint[1]);
+            }
+
+            std::array<int, N> targets;
+            std::array<int, N> counts;
+            int totalTarget = 0;
+            for (int i = 0; i < N; ++i)
+            {
+                targets[i] = int(float(layers[i].targetCount) * area + 0.5f);
+                counts[i] = 0;
+                totalTarget += targets[i];
+            }
+
+            std::vector<Point> made;
+            const int c_failCountFatal = totalTarget * 20 + 100;
+            int failCount = 0;
+            while (failCount <= c_failCountFatal)
+            {
+                // find the class which is least filled.
+                float leastPercent = FLT_MAX;
+                int leastPercentClass = -1;
+                for (int i = 0; i < N; ++i)
+                {
+                    if (counts[i] >= targets[i])
+                        continue;
+                    float percent = float(counts[i]) / float(targets[i]);
+                    if (percent < leastPercent)
+                    {
+                        leastPercent = percent;
+                        leastPercentClass = i;
+                    }
+                }
+                if (leastPercentClass == -1)
+                    break;
+
+                Vec2 point = rng();
+                point[0] = Lerp(rectMin[0], rectMax[0], point[0]);
+                point[1] = Lerp(rectMin[1], rectMax[1], point[1]);
+                if (excluded(point))
+                    continue;
+
+                Hard::FindConflicts(ToGrid(point), leastPercentClass, grids, gridRMatrix, false, true, conflicts);
+                if (conflicts.size() == 0)
+                {
+                    failCount = 0;
+                    workPoints.push_back({ leastPercentClass, point });
+                    made.push_back({ leastPercentClass, point });
+                    counts[leastPercentClass]++;
+                    Vec2 gridPoint = ToGrid(point);
+                    grids[leastPercentClass].AddPoint((int)workPoints.size() - 1, gridPoint[0], gridPoint[1]);
+                }
+                else
+                    failCount++;
+            }
+            return made;
+        };
+
+        // adds points moved by an offset to a list
+        auto AddMoved = [](std::vector<Point>& dest, const std::vector<Point>& src, float offsetX, float offsetY)
+        {
+            for (const Point& p : src)
+                dest.push_back({ p.classIndex, Vec2{ p.v[0] + offsetX, p.v[1] + offsetY } });
+        };
+        auto NotExcluded = [](const Vec2& v) { return false; };
+
+        int regionCount = colorCount + 2 * colorCount * colorCount + colorCount * colorCount * colorCount * colorCount;
+        int regionIndex = 0;
+        auto ShowProgress = [&]()
+        {
+            printf("\r%i%%", int(100.0f * float(regionIndex) / float(regionCount)));
+            regionIndex++;
+        };
+
+        // corners, centered on (0,0)
+        std::vector<std::vector<Point>> corners(colorCount);
+        for (int color = 0; color < colorCount; ++color)
+        {
+            ShowProgress();
+            corners[color] = Fill(Vec2{ -a, -a }, Vec2{ a, a }, 4.0f * a * a, {}, NotExcluded);
+        }
+
+        // edges, from a corner at (0,0) to one at (1,0) for horizontal edges, or (0,1) for vertical ones
+        std::vector<std::vector<Point>> horizontalEdges(colorCount * colorCount);
+        std::vector<std::vector<Point>> verticalEdges(colorCount * colorCount);
+        float edgeArea = (1.0f - 2.0f * a) * 2.0f * b;
+        for (int color0 = 0; color0 < colorCount; ++color0)
+        {
+            for (int color1 = 0; color1 < colorCount; ++color1)
+            {
+                std::vector<Point> existing;
+
+                ShowProgress();
+                AddMoved(existing, corners[color0], 0.0f, 0.0f);
+                AddMoved(existing, corners[color1], 1.0f, 0.0f);
+                horizontalEdges[color0 * colorCount + color1] = Fill(Vec2{ a, -b }, Vec2{ 1.0f - a, b }, edgeArea, existing, NotExcluded);
+
+                ShowProgress();
+                existing.clear();
+                AddMoved(existing, corners[color0], 0.0f, 0.0f);
+                AddMoved(existing, corners[color1], 0.0f, 1.0f);
+                verticalEdges[color0 * colorCount + color1] = Fill(Vec2{ -b, a }, Vec2{ b, 1.0f - a }, edgeArea, existing, NotExcluded);
+            }
+        }
+
+        // tiles. The interior is what's left of [b, 1-b]^2 outside of the corner squares.
+        auto InCornerSquare = [a](const Vec2& v)
+        {
+            return (v[0] < a || v[0] > 1.0f - a) && (v[1] < a || v[1] > 1.0f - a);
+        };
+        float interiorArea = (1.0f - 2.0f * b) * (1.0f - 2.0f * b) - 4.0f * (a - b) * (a - b);
+
+        ret.colorCount = colorCount;
+        ret.tiles.resize(colorCount * colorCount * colorCount * colorCount);
+        for (int c00 = 0; c00 < colorCount; ++c00)
+        {
+            for (int c10 = 0; c10 < colorCount; ++c10)
+            {
+                for (int c01 = 0; c01 < colorCount; ++c01)
+                {
+                    for (int c11 = 0; c11 < colorCount; ++c11)
+                    {
+                        ShowProgress();
+
+                        std::vector<Point> existing;
+                        AddMoved(existing, corners[c00], 0.0f, 0.0f);
+                        AddMoved(existing, corners[c10], 1.0f, 0.0f);
+                        AddMoved(existing, corners[c01], 0.0f, 1.0f);
+                        AddMoved(existing, corners[c11], 1.0f, 1.0f);
+                        AddMoved(existing, horizontalEdges[c00 * colorCount + c10], 0.0f, 0.0f);
+                        AddMoved(existing, horizontalEdges[c01 * colorCount + c11], 0.0f, 1.0f);
+                        AddMoved(existing, verticalEdges[c00 * colorCount + c01], 0.0f, 0.0f);
+                        AddMoved(existing, verticalEdges[c10 * colorCount + c11], 1.0f, 0.0f);
+
+                        std::vector<Point> interior = Fill(Vec2{ b, b }, Vec2{ 1.0f - b, 1.0f - b }, interiorArea, existing, InCornerSquare);
+
+                        // the tile is everything in [0,1)^2, with the classes in the order that the user asked for
+                        std::vector<Point>& tile = ret.tiles[ret.TileIndex(c00, c10, c01, c11)];
+                        existing.insert(existing.end(), interior.begin(), interior.end());
+                        for (const Point& p : existing)
+                        {
+                            if (p.v[0] >= 0.0f && p.v[0] < 1.0f && p.v[1] >= 0.0f && p.v[1] < 1.0f)
+                                tile.push_back({ layers[p.classIndex].originalIndex, p.v });
+                        }
+                    }
+                }
+            }
+        }
+        printf("\r100%%\n");
+
+        return ret;
+    }
+
+    // The color of a lattice corner. It only depends on the corner and the seed, so any part of an
+    // unbounded tiling can be made on its own.
+    inline int CornerColor(const TileSet& tileSet, int x, int y, uint64_t seed)
+    {
+        uint32_t random[4];
+        CounterRandomUint32x4(seed, 0, (uint64_t(uint32_t(y)) << 32) | uint64_t(uint32_t(x)), random);
+        return int(random[0] % uint32_t(tileSet.colorCount));
+    }
+
+    // Tiles tilesX by tilesY tiles, starting at tile (startX, startY) of the unbounded tiling for the seed.
+    // The points are scaled by the same amount on both axes, so the tiles stay square and the r matrix holds, with the
+    // longer side of the tiling fitting in [0,1). The output is tilesX / tilesY as wide as it is tall, so when tilesX
+    // and tilesY differ, it only covers [0, tilesX / max) x [0, tilesY / max) of the unit square.
+    inline std::vector<Point> Tile(const TileSet& tileSet, int tilesX, int tilesY, uint64_t seed, int startX = 0, int startY = 0)
+    {
+        std::vector<Point> ret;
+        if (tileSet.tiles.empty())
+            return ret;
+
+        float scale = 1.0f / float(std::max(tilesX, tilesY));
+        for (int tileY = 0; tileY < tilesY; ++tileY)
+        {
+            for (int tileX = 0; tileX < tilesX; ++tileX)
+            {
+                int x = startX + tileX;
+                int y = startY + tileY;
+                int tileIndex = tileSet.TileIndex(
+                    CornerColor(tileSet, x, y, seed),
+                    CornerColor(tileSet, x + 1, y, seed),
+                    CornerColor(tileSet, x, y + 1, seed),
+                    CornerColor(tileSet, x + 1, y + 1, seed)
+                );
+
+                for (const Point& p : tileSet.tiles[tileIndex])
+                {
+                    Vec2 v = Vec2{ (float(tileX) + p.v[0]) * scale, (float(tileY) + p.v[1]) * scale };
+                    v[0] = std::min(v[0], 0.99999994f);
+                    v[1] = std::min(v[1], 0.99999994f);
+                    ret.push_back({ p.classIndex, v });
+                }
+            }
+        }
+
+        return ret;
+    }
+};
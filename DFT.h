@@ -0,0 +1,169 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "FFT.h"
+#include "PNG.h"
+#include "ThreadPool.h"
+
+// DFT images of sets of grey images, the way MultiDFT.py makes them, without leaving the program.
+//
+// Each image is scaled to [0, 1], and its DFT magnitude has DC zeroed, goes through log(1 + x), and is shifted so DC
+// is in the center. The average of that over a set of images is written out with the viridis color map, clipped to a
+// range, which is what MultiDFT.py's "dftavg" image shows, without the plot around it.
+//
+// Images are real, so they are transformed two at a time, one as the real part and one as the imaginary part, and
+// pulled apart afterwards using the symmetry of real DFTs. The transforms of every set are done in parallel.
+
+namespace DFT
+{
+    // The viridis color map, for t in [0, 1]. These are every 32nd entry of matplotlib's 256 entry table, and the last.
+    inline void Viridis(float t, unsigned char(&RGB)[3])
+    {
+        static const float c_viridis[9][3] =
+        {
+            { 0.267004f, 0.004874f, 0.329415f },
+            { 0.282623f, 0.140926f, 0.457517f },
+            { 0.229739f, 0.322361f, 0.545706f },
+            { 0.172719f, 0.448791f, 0.557885f },
+            { 0.127568f, 0.566949f, 0.550556f },
+            { 0.157851f, 0.683765f, 0.501686f },
+            { 0.369214f, 0.788888f, 0.382914f },
+            { 0.678489f, 0.863742f, 0.189503f },
+            { 0.993248f, 0.906157f, 0.143936f },
+        };
+
+        float position = Clamp(t, 0.0f, 1.0f) * 8.0f;
+        int index = std::min(int(position), 7);
+        float fraction = position - float(index);
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            float value = Lerp(c_viridis[index][channel], c_viridis[index + 1][channel], fraction);
+            RGB[channel] = (unsigned char)Clamp(value * 256.0f, 0.0f, 255.0f);
+        }
+    }
+
+    // For each set of size x size grey images, the average over the set of log(1 + |DFT|), with DC zeroed and shifted
+    // to the center. size must be a power of 2.
+    inline std::vector<std::vector<float>> AverageLogMagnitudes(const std::vector<std::vector<const unsigned char*>>& imageSets, int size)
+    {
+        typedef FFT::Complex Complex;
+
+        // the images of a set are transformed in pairs
+        struct Pair
+        {
+            int setIndex;
+            int imageIndex;
+        };
+        std::vector<Pair> pairs;
+        for (int setIndex = 0; setIndex < (int)imageSets.size(); ++setIndex)
+        {
+            for (int imageIndex = 0; imageIndex < (int)imageSets[setIndex].size(); imageIndex += 2)
+                pairs.push_back({ setIndex, imageIndex });
+        }
+
+        // every image's log magnitudes, which are averaged at the end
+        std::vector<std::vector<std::vector<float>>> logMagnitudes(imageSets.size());
+        for (size_t setIndex = 0; setIndex < imageSets.size(); ++setIndex)
+            logMagnitudes[setIndex].resize(imageSets[setIndex].size());
+
+        // a plan and buffer per thread, since the transforms run at the same time
+        ThreadPool& threadPool = GetThreadPool();
+        std::vector<FFT::Plan2D> plans(threadPool.ThreadCount());
+        std::vector<std::vector<Complex>> buffers(threadPool.ThreadCount());
+
+        int halfSize = size / 2;
+        threadPool.ParallelFor((int)pairs.size(),
+            [&](int index, int threadIndex)
+            {
+                const Pair& pair = pairs[index];
+                const std::vector<const unsigned char*>& images = imageSets[pair.setIndex];
+                const unsigned char* imageA = images[pair.imageIndex];
+                const unsigned char* imageB = (pair.imageIndex + 1 < (int)images.size()) ? images[pair.imageIndex + 1] : nullptr;
+
+                FFT::Plan2D& plan = plans[threadIndex];
+                if (plan.Width() != size)
+                    plan.Init(size, size);
+
+                std::vector<Complex>& data = buffers[threadIndex];
+                data.resize(size * size);
+                for (int i = 0; i < size * size; ++i)
+                    data[i] = Complex(float(imageA[i]) / 255.0f, imageB ? float(imageB[i]) / 255.0f : 0.0f);
+                plan.Transform(data, false, false);
+
+                // A(k) = (Z(k) + conj(Z(-k))) / 2 and B(k) = (Z(k) - conj(Z(-k))) / 2i
+                std::vector<float>& outA = logMagnitudes[pair.setIndex][pair.imageIndex];
+                outA.resize(size * size);
+                std::vector<float>* outB = imageB ? &logMagnitudes[pair.setIndex][pair.imageIndex + 1] : nullptr;
+                if (outB)
+                    outB->resize(size * size);
+
+                for (int y = 0; y < size; ++y)
+                {
+                    int negY = (size - y) % size;
+                    int shiftedY = (y + halfSize) % size;
+                    for (int x = 0; x < size; ++x)
+                    {
+                        int negX = (size - x) % size;
+                        int shifted = shiftedY * size + (x + halfSize) % size;
+
+                        Complex z = data[y * size + x];
+                        Complex zNegConj = std::conj(data[negY * size + negX]);
+                        bool isDC = (x == 0 && y == 0);
+                        outA[shifted] = isDC ? 0.0f : logf(1.0f + std::abs(z + zNegConj) * 0.5f);
+                        if (outB)
+                            (*outB)[shifted] = isDC ? 0.0f : logf(1.0f + std::abs(z - zNegConj) * 0.5f);
+                    }
+                }
+            }
+        );
+
+        std::vector<std::vector<float>> ret(imageSets.size());
+        threadPool.ParallelFor((int)imageSets.size(),
+            [&](int setIndex, int threadIndex)
+            {
+                std::vector<float>& average = ret[setIndex];
+                average.assign(size * size, 0.0f);
+                for (const std::vector<float>& logMagnitude : logMagnitudes[setIndex])
+                {
+                    for (int i = 0; i < size * size; ++i)
+                        average[i] += logMagnitude[i];
+                }
+
+                float scale = logMagnitudes[setIndex].empty() ? 0.0f : 1.0f / float(logMagnitudes[setIndex].size());
+                for (float& f : average)
+                    f *= scale;
+            }
+        );
+
+        return ret;
+    }
+
+    // Writes a size x size image of values with the viridis color map, where clipMin is the bottom of the color map and
+    // clipMax is the top
+    inline bool WriteColorMap(const char* fileName, const std::vector<float>& values, int size, float clipMin, float clipMax,
+        PNG::Compression compression = PNG::Compression::Fast)
+    {
+        float minValue = values.empty() ? 0.0f : values[0];
+        float maxValue = minValue;
+        for (float f : values)
+        {
+            minValue = std::min(minValue, f);
+            maxValue = std::max(maxValue, f);
+        }
+        printf("actual min/max of %s = (%f, %f)\n", fileName, minValue, maxValue);
+
+        std::vector<unsigned char> pixels(values.size() * 3);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            unsigned char RGB[3];
+            Viridis((values[i] - clipMin) / (clipMax - clipMin), RGB);
+            pixels[i * 3 + 0] = RGB[0];
+            pixels[i * 3 + 1] = RGB[1];
+            pixels[i * 3 + 2] = RGB[2];
+        }
+        return PNG::Write(fileName, size, size, 3, pixels.data(), compression);
+    }
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+// An incremental (Bowyer-Watson) Delaunay triangulation of points on the unit torus.
+// Each point is added along with its 8 periodic copies in the surrounding tiles, inside one large super triangle.
+// A triangle whose circumcenter is in [0,1)^2, and which doesn't use a super triangle vertex, is a triangle of
+// the periodic triangulation, once there is at least one point, since its circumcircle is then smaller than a tile.
+// Triangles are recycled, and get a new version when they are, so that other code can hold on to them.
+
+class PeriodicDelaunay
+{
+public:
+    struct Triangle
+    {
+        int v[3];           // vertices, counter clockwise
+        int n[3];           // n[i] is the neighbor across the edge opposite v[i], or -1
+        double centerX, centerY, radiusSq;
+        bool alive = false;
+        uint32_t version = 0;
+    };
+
+    PeriodicDelaunay()
+    {
+        // a super triangle that holds all of [-1,2]^2 with lots of room to spare
+        m_vertices.push_back({ -1000.0, -1000.0 });
+        m_vertices.push_back({ 1000.0, -1000.0 });
+        m_vertices.push_back({ 0.0, 1000.0 });
+        m_vertexTriangle.assign(3, 0);
+        MakeTriangle(0, 1, 2);
+    }
+
+    int PointCount() const
+    {
+        return m_pointCount;
+    }
+
+    int TriangleCount() const
+    {
+        return (int)m_triangles.size();
+    }
+
+    const Triangle& GetTriangle(int index) const
+    {
+        return m_triangles[index];
+    }
+
+    // True if the triangle is alive and is one of the triangles of the periodic triangulation
+    bool IsCanonical(int index) const
+    {
+        const Triangle& t = m_triangles[index];
+        if (!t.alive || t.v[0] < 3 || t.v[1] < 3 || t.v[2] < 3)
+            return false;
+        return t.centerX >= 0.0 && t.centerX < 1.0 && t.centerY >= 0.0 && t.centerY < 1.0;
+    }
+
+    Vec2 Circumcenter(int index) const
+    {
+        const Triangle& t = m_triangles[index];
+        return Vec2{ std::min(float(t.centerX), 0.99999994f), std::min(float(t.centerY), 0.99999994f) };
+    }
+
+    float CircumRadius(int index) const
+    {
+        return float(std::sqrt(m_triangles[index].radiusSq));
+    }
+
+    // Which point, in the order they were added, a vertex is a copy of. The super triangle's vertices are -1.
+    int VertexPoint(int vertex) const
+    {
+        return (vertex < 3) ? -1 : (vertex - 3) / 9;
+    }
+
+    // Adds a point in [0,1)^2 and its periodic copies. hintTriangle is a triangle near the point, or -1.
+    // onNewTriangle(index) is called for every triangle made.
+    template <typename LAMBDA>
+    void AddPoint(const Vec2& point, int hintTriangle, const LAMBDA& onNewTriangle)
+    {
+        m_pointCount++;
+        int firstVertex = (int)m_vertices.size();
+        for (int copy = 0; copy < 9; ++copy)
+        {
+            m_vertices.push_back({ double(point[0]) + double(CopyOffsetX(copy)), double(point[1]) + double(CopyOffsetY(copy)) });
+            m_vertexTriangle.push_back(-1);
+        }
+
+        // the copy in the middle tile goes first. A vertex joined to it has copies near each of the other copies,
+        // which are good places to start looking from.
+        int neighborVertex = -1;
+        for (int copy = 0; copy < 9; ++copy)
+        {
+            int vertex = firstVertex + copy;
+            int start = hintTriangle;
+            if (copy > 0 && neighborVertex >= 0)
+            {
+                int neighborCopy = CopyOf(neighborVertex, CopyOffsetX(copy), CopyOffsetY(copy));
+                if (neighborCopy >= 0)
+                    start = m_vertexTriangle[neighborCopy];
+            }
+            if (start < 0 || !m_triangles[start].alive)
+                start = m_lastTriangle;
+
+            InsertVertex(vertex, start, onNewTriangle);
+
+            if (copy == 0)
+            {
+                const Triangle& t = m_triangles[m_vertexTriangle[vertex]];
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (t.v[i] != vertex && t.v[i] >= 3)
+                        neighborVertex = t.v[i];
+                }
+            }
+        }
+    }
+
+private:
+    // copy 0 is the middle tile
+    static int CopyOffsetX(int copy)
+    {
+        static const int c_offsets[9] = { 0, -1, 1, -1, 0, 1, -1, 0, 1 };
+        return c_offsets[copy];
+    }
+
+    static int CopyOffsetY(int copy)
+    {
+        static const int c_offsets[9] = { 0, 0, 0, -1, -1, -1, 1, 1, 1 };
+        return c_offsets[copy];
+    }
+
+    // The vertex for the same point as vertex, moved by (dx, dy) tiles, or -1 if that copy doesn't exist
+    int CopyOf(int vertex, int dx, int dy) const
+    {
+        int pointIndex = (vertex - 3) / 9;
+        int copy = (vertex - 3) % 9;
+        int x = CopyOffsetX(copy) + dx;
+        int y = CopyOffsetY(copy) + dy;
+        for (int other = 0; other < 9; ++other)
+        {
+            if (CopyOffsetX(other) == x && CopyOffsetY(other) == y)
+                return 3 + pointIndex * 9 + other;
+        }
+        return -1;
+    }
+
+    double Orient(int a, int b, double x, double y) const
+    {
+        const std::array<double, 2>& A = m_vertices[a];
+        const std::array<double, 2>& B = m_vertices[b];
+        return (B[0] - A[0]) * (y - A[1]) - (B[1] - A[1]) * (x - A[0]);
+    }
+
+    bool InCircumcircle(int triangle, double x, double y) const
+    {
+        const Triangle& t = m_triangles[triangle];
+        double dx = x - t.centerX;
+        double dy = y - t.centerY;
+        return dx * dx + dy * dy < t.radiusSq;
+    }
+
+    int MakeTriangle(int a, int b, int c)
+    {
+        int index;
+        if (!m_freeTriangles.empty())
+        {
+            index = m_freeTriangles.back();
+            m_freeTriangles.pop_back();
+        }
+        else
+        {
+            index = (int)m_triangles.size();
+            m_triangles.push_back(Triangle());
+            m_cavityStamp.push_back(0);
+        }
+
+        Triangle& t = m_triangles[index];
+        t.v[0] = a;
+        t.v[1] = b;
+        t.v[2] = c;
+        t.n[0] = t.n[1] = t.n[2] = -1;
+        t.alive = true;
+
+        // circumcenter, relative to a for precision
+        const std::array<double, 2>& A = m_vertices[a];
+        double bx = m_vertices[b][0] - A[0];
+        double by = m_vertices[b][1] - A[1];
+        double cx = m_vertices[c][0] - A[0];
+        double cy = m_vertices[c][1] - A[1];
+        double d = 2.0 * (bx * cy - by * cx);
+        double bLenSq = bx * bx + by * by;
+        double cLenSq = cx * cx + cy * cy;
+        double ux = (cy * bLenSq - by * cLenSq) / d;
+        double uy = (bx * cLenSq - cx * bLenSq) / d;
+        t.centerX = A[0] + ux;
+        t.centerY = A[1] + uy;
+        t.radiusSq = ux * ux + uy * uy;
+
+        m_vertexTriangle[a] = m_vertexTriangle[b] = m_vertexTriangle[c] = index;
+        m_lastTriangle = index;
+        return index;
+    }
+
+    // Walks from the start triangle towards the point, until it finds the triangle containing it
+    int Locate(int start, double x, double y) const
+    {
+        int current = start;
+        int steps = 0;
+        while (true)
+        {
+            const Triangle& t = m_triangles[current];
+            int next = -1;
+
+            // starting at a different edge each step avoids walking in circles
+            for (int edge = 0; edge < 3; ++edge)
+            {
+                int i = (edge + steps) % 3;
+                if (t.n[i] >= 0 && Orient(t.v[(i + 1) % 3], t.v[(i + 2) % 3], x, y) < 0.0)
+                {
+                    next = t.n[i];
+                    break;
+                }
+            }
+            if (next < 0)
+                return current;
+            current = next;
+            steps++;
+        }
+    }
+
+    template <typename LAMBDA>
+    void InsertVertex(int vertex, int start, const LAMBDA& onNewTriangle)
+    {
+        double x = m_vertices[vertex][0];
+        double y = m_vertices[vertex][1];
+
+        // find the cavity: the connected triangles whose circumcircles contain the point
+        int first = Locate(start, x, y);
+        m_stamp++;
+        m_cavity.clear();
+        m_boundary.clear();
+        m_cavity.push_back(first);
+        m_cavityStamp[first] = m_stamp;
+        for (size_t cavityIndex = 0; cavityIndex < m_cavity.size(); ++cavityIndex)
+        {
+            int triangle = m_cavity[cavityIndex];
+            for (int i = 0; i < 3; ++i)
+            {
+                int neighbor = m_triangles[triangle].n[i];
+                if (neighbor >= 0 && m_cavityStamp[neighbor] == m_stamp)
+                    continue;
+
+                if (neighbor >= 0 && InCircumcircle(neighbor, x, y))
+                {
+                    m_cavityStamp[neighbor] = m_stamp;
+                    m_cavity.push_back(neighbor);
+                }
+                else
+                {
+                    const Triangle& t = m_triangles[triangle];
+                    m_boundary.push_back({ t.v[(i + 1) % 3], t.v[(i + 2) % 3], neighbor, triangle });
+                }
+            }
+        }
+
+        // the cavity's triangles die. They are only recycled after the new triangles are made, so that
+        // neighbors pointing at them can still be found.
+        for (int triangle : m_cavity)
+        {
+            m_triangles[triangle].alive = false;
+            m_triangles[triangle].version++;
+        }
+
+        // fill it with a fan of triangles around the point
+        m_firstVertexTriangle.resize(m_vertices.size());
+        m_secondVertexTriangle.resize(m_vertices.size());
+        m_newTriangles.clear();
+        for (const BoundaryEdge& edge : m_boundary)
+        {
+            int triangle = MakeTriangle(edge.a, edge.b, vertex);
+            m_triangles[triangle].n[2] = edge.outside;
+            if (edge.outside >= 0)
+            {
+                Triangle& outside = m_triangles[edge.outside];
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (outside.n[i] == edge.dead)
+                        outside.n[i] = triangle;
+                }
+            }
+            m_firstVertexTriangle[edge.a] = triangle;
+            m_secondVertexTriangle[edge.b] = triangle;
+            m_newTriangles.push_back(triangle);
+        }
+
+        // link the fan's triangles to each other
+        for (int triangle : m_newTriangles)
+        {
+            Triangle& t = m_triangles[triangle];
+            t.n[0] = m_firstVertexTriangle[t.v[1]];
+            t.n[1] = m_secondVertexTriangle[t.v[0]];
+        }
+
+        for (int triangle : m_cavity)
+            m_freeTriangles.push_back(triangle);
+
+        for (int triangle : m_newTriangles)
+            onNewTriangle(triangle);
+    }
+
+    struct BoundaryEdge
+    {
+        int a, b;       // counter clockwise around the cavity
+        int outside;    // the triangle across the edge, or -1
+        int dead;       // the cavity triangle that had this edge
+    };
+
+    std::vector<std::array<double, 2>> m_vertices;
+    std::vector<int> m_vertexTriangle;
+    std::vector<Triangle> m_triangles;
+    std::vector<int> m_freeTriangles;
+    int m_lastTriangle = 0;
+    int m_pointCount = 0;
+
+    // scratch memory for InsertVertex
+    std::vector<uint32_t> m_cavityStamp;
+    uint32_t m_stamp = 0;
+    std::vector<int> m_cavity;
+    std::vector<BoundaryEdge> m_boundary;
+    std::vector<int> m_firstVertexTriangle;
+    std::vector<int> m_secondVertexTriangle;
+    std::vector<int> m_newTriangles;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Power of 2 sized complex FFTs, in 1D and 2D.
+// The forward transform is unscaled, and the inverse divides by the number of values, so a round trip
+// gives back what went in. 2D transforms do rows then columns on the thread pool.
+
+namespace FFT
+{
+    typedef std::complex<float> Complex;
+
+    inline bool IsPowerOf2(int size)
+    {
+        return size > 0 && (size & (size - 1)) == 0;
+    }
+
+    // The twiddle factors and bit reversal table for one size, made once and reused for every transform
+    class Plan
+    {
+    public:
+        void Init(int size)
+        {
+            m_size = size;
+
+            int bits = 0;
+            while ((1 << bits) < size)
+                bits++;
+
+            m_reverse.resize(size);
+            for (int i = 0; i < size; ++i)
+            {
+                int reversed = 0;
+                for (int bit = 0; bit < bits; ++bit)
+                {
+                    if (i & (1 << bit))
+                        reversed |= 1 << (bits - 1 - bit);
+                }
+                m_reverse[i] = reversed;
+            }
+
+            // calculated in double so that large sizes are still accurate
+            m_twiddles.resize(std::max(size / 2, 1));
+            for (int i = 0; i < size / 2; ++i)
+            {
+                double angle = -2.0 * 3.14159265358979323846 * double(i) / double(size);
+                m_twiddles[i] = Complex(float(std::cos(angle)), float(std::sin(angle)));
+            }
+        }
+
+        int Size() const
+        {
+            return m_size;
+        }
+
+        // In place transform of Size() contiguous values
+        void Transform(Complex* data, bool inverse) const
+        {
+            for (int i = 0; i < m_size; ++i)
+            {
+                int j = m_reverse[i];
+                if (i < j)
+                    std::swap(data[i], data[j]);
+            }
+
+            // iterative radix 2 butterflies. The complex multiply is written out, because std::complex's
+            // handles infinities and NaNs, which is a lot slower on some compilers.
+            float twiddleSign = inverse ? -1.0f : 1.0f;
+            for (int halfSize = 1; halfSize < m_size; halfSize *= 2)
+            {
+                int twiddleStep = m_size / (halfSize * 2);
+                for (int start = 0; start < m_size; start += halfSize * 2)
+                {
+                    for (int i = 0; i < halfSize; ++i)
+                    {
+                        float twiddleRe = m_twiddles[i * twiddleStep].real();
+                        float twiddleIm = m_twiddles[i * twiddleStep].imag() * twiddleSign;
+
+                        Complex a = data[start + i];
+                        Complex c = data[start + i + halfSize];
+                        Complex b = Complex(c.real() * twiddleRe - c.imag() * twiddleIm, c.real() * twiddleIm + c.imag() * twiddleRe);
+                        data[start + i] = a + b;
+                        data[start + i + halfSize] = a - b;
+                    }
+                }
+            }
+
+            if (inverse)
+            {
+                float scale = 1.0f / float(m_size);
+                for (int i = 0; i < m_size; ++i)
+                    data[i] *= scale;
+            }
+        }
+
+    private:
+        int m_size = 0;
+        std::vector<int> m_reverse;
+        std::vector<Complex> m_twiddles;
+    };
+
+    // A 2D transform of a row major width x height image, in place
+    class Plan2D
+    {
+    public:
+        void Init(int width, int height)
+        {
+            m_rows.Init(width);
+            m_columns.Init(height);
+        }
+
+        int Width() const
+        {
+            return m_rows.Size();
+        }
+
+        int Height() const
+        {
+            return m_columns.Size();
+        }
+
+        void Transform(std::vector<Complex>& data, bool inverse, bool multithreaded = true)
+        {
+            int width = Width();
+            int height = Height();
+
+            ThreadPool& threadPool = GetThreadPool();
+            int threadCount = multithreaded ? threadPool.ThreadCount() : 1;
+            m_scratch.resize(threadCount);
+
+            auto DoRow = [&](int y, int threadIndex)
+            {
+                m_rows.Transform(&data[y * width], inverse);
+            };
+
+            // columns are copied out to be contiguous, which is also much friendlier to the cache
+            auto DoColumn = [&](int x, int threadIndex)
+            {
+                std::vector<Complex>& column = m_scratch[threadIndex];
+                column.resize(height);
+                for (int y = 0; y < height; ++y)
+                    column[y] = data[y * width + x];
+                m_columns.Transform(column.data(), inverse);
+                for (int y = 0; y < height; ++y)
+                    data[y * width + x] = column[y];
+            };
+
+            if (threadCount > 1)
+            {
+                threadPool.ParallelFor(height, DoRow, 8);
+                threadPool.ParallelFor(width, DoColumn, 8);
+            }
+            else
+            {
+                for (int y = 0; y < height; ++y)
+                    DoRow(y, 0);
+                for (int x = 0; x < width; ++x)
+                    DoColumn(x, 0);
+            }
+        }
+
+    private:
+        Plan m_rows;
+        Plan m_columns;
+        std::vector<std::vector<Complex>> m_scratch;
+    };
+};
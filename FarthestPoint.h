@@ -0,0 +1,238 @@
+#pragma once
+
+#include <queue>
+
+#include "Delaunay.h"
+#include "Grid.h"
+
+// Multi class farthest point sampling on the torus. Each point goes where it is farthest from the existing points,
+// with distances to points of class j divided by rMatrix[c][j] when placing a point of class c. This is what Soft's
+// best candidate sampling approximates, but without the quadratic number of candidates.
+//
+// The farthest point from a set of points is the circumcenter of the largest triangle in their Delaunay
+// triangulation. All points go in one periodic Delaunay triangulation, and each class has a max heap of its
+// triangles. A triangle's circumcircle is empty, and goes through its 3 vertices, so its circumcenter's score for
+// class c is at most circumradius / rMatrix[c][k], for each vertex's class k. The smallest of those is the key.
+// The top of the heap is scored against all classes with the grids, and goes back in keyed by its score, until
+// the top's score is known. Scores only go down as points are added, so each triangle is only rescored when
+// its last score gets to the top again, which keeps it O(n log n).
+//
+// Weighting the classes differently makes the true farthest point a vertex of a weighted Voronoi diagram,
+// which isn't always a Delaunay circumcenter, so with more than one class this is a close approximation.
+// Classes in the same priority group have no r matrix entry between them, so they don't bound each other's keys.
+
+namespace FarthestPoint
+{
+    struct Layer
+    {
+        float radius = 0.0f;
+        int originalIndex = 0;
+        int sampleCount = 0;
+        int targetCount = 0;
+    };
+
+    struct HeapEntry
+    {
+        float key;
+        int triangle;
+        uint32_t version;
+
+        bool operator < (const HeapEntry& other) const
+        {
+            return key < other.key;
+        }
+    };
+
+    // The score of a point for class c: the smallest distance to a point of class j divided by rMatrix[c][j].
+    // bound is a known upper bound of the score.
+    template <size_t N>
+    float Score(const Vec2& v, int c, float bound, const std::vector<Grid<100, 100>>& grids, const std::array<std::array<float, N>, N>& rMatrix, std::vector<float>& distances)
+    {
+        float score = bound;
+        for (int j = 0; j < N; ++j)
+        {
+            if (rMatrix[c][j] <= 0.0f)
+                continue;
+
+            // only points closer than the score so far matter. Distances on the unit torus are at most sqrt(0.5).
+            float radius = std::min(score * rMatrix[c][j], 0.75f);
+            grids[j].GetPointDistancesSq<true>(v[0], v[1], radius, distances, false);
+            for (float distSq : distances)
+                score = std::min(score, std::sqrt(distSq) / rMatrix[c][j]);
+        }
+        return score;
+    }
+
+    // RNG is called like RNGContinuous, and is only used for the first point
+    template <size_t N, typename RNG>
+    std::vector<Point> Make(const int(&counts)[N], RNG& rng)
+    {
+        std::vector<Grid<100, 100>> grids(N);
+
+        // make the layer data
+        int totalCount = 0;
+        std::vector<Layer> layers(N);
+        for (int i = 0; i < N; ++i)
+        {
+            float packing_density = c_pi * std::sqrt(3.0f) / 6.0f;
+            layers[i].radius = 2.0f * std::pow(packing_density / (c_pi * float(counts[i])), 1.0f / 2.0f);
+            layers[i].originalIndex = i;
+            layers[i].targetCount = counts[i];
+            totalCount += counts[i];
+        }
+
+        // sort the layers from largest to smallest radius
+        std::sort(
+            layers.begin(),
+            layers.end(),
+            [](const Layer& A, const Layer& B)
+            {
+                return A.radius > B.radius;
+            }
+        );
+
+        // Make the r matrix
+        std::array<std::array<float, N>, N> rMatrix;
+        {
+            for (int i = 0; i < N; ++i)
+            {
+                std::fill(rMatrix[i].begin(), rMatrix[i].end(), 0.0f);
+                rMatrix[i][i] = layers[i].radius;
+            }
+
+            int classStartIndex = -1;
+            int classEndIndex = 0;
+            float totalDensity = 0.0f;
+            while (true)
+            {
+                classStartIndex = classEndIndex;
+                if (classStartIndex >= N)
+                    break;
+
+                while (classEndIndex < N && layers[classEndIndex].radius == layers[classStartIndex].radius)
+                    classEndIndex++;
+
+                for (int i = classStartIndex; i < classEndIndex; ++i)
+                    totalDensity += 1.0f / (layers[i].radius * layers[i].radius);
+
+                for (int i = classStartIndex; i < classEndIndex; ++i)
+                {
+                    for (int j = 0; j < classStartIndex; ++j)
+                        rMatrix[i][j] = rMatrix[j][i] = 1.0f / std::sqrt(totalDensity);
+                }
+            }
+        }
+
+        PeriodicDelaunay triangulation;
+        std::vector<std::priority_queue<HeapEntry>> heaps(N);
+
+        // Make the points!
+        std::vector<Point> ret;
+        {
+            // out here to avoid allocs
+            std::vector<float> distances;
+
+            int lastPercent = -1;
+            for (int pointIndex = 0; pointIndex < totalCount; ++pointIndex)
+            {
+                int percent = int(100.0f * float(pointIndex) / float(totalCount));
+                if (percent != lastPercent)
+                {
+                    printf("\r%i%%", percent);
+                    lastPercent = percent;
+                }
+
+                // find the class which is least filled.
+                float leastPercent = FLT_MAX;
+                int leastPercentClass = -1;
+                for (int i = 0; i < N; ++i)
+                {
+                    float percent = float(layers[i].sampleCount) / float(layers[i].targetCount);
+                    if (percent < leastPercent)
+                    {
+                        leastPercent = percent;
+                        leastPercentClass = i;
+                    }
+                }
+                int c = leastPercentClass;
+
+                Vec2 bestPoint = Vec2{ 0.0f, 0.0f };
+                int bestTriangle = -1;
+                if (ret.empty())
+                {
+                    bestPoint = rng();
+                }
+                else
+                {
+                    // lazy greedy search of the heap. Keys are upper bounds, and scores only go down as points are
+                    // added, so a scored triangle goes back in with its score as the key, and the top is the best once
+                    // its score is at least the next key.
+                    std::priority_queue<HeapEntry>& heap = heaps[c];
+                    auto IsStale = [&](const HeapEntry& entry)
+                    {
+                        const PeriodicDelaunay::Triangle& t = triangulation.GetTriangle(entry.triangle);
+                        return !t.alive || t.version != entry.version;
+                    };
+                    while (!heap.empty())
+                    {
+                        HeapEntry entry = heap.top();
+                        heap.pop();
+                        if (IsStale(entry))
+                            continue;
+
+                        Vec2 v = triangulation.Circumcenter(entry.triangle);
+                        entry.key = Score(v, c, entry.key, grids, rMatrix, distances);
+
+                        while (!heap.empty() && IsStale(heap.top()))
+                            heap.pop();
+
+                        // it stays in the heap either way. The chosen one dies when its circumcenter is added.
+                        bool best = heap.empty() || entry.key >= heap.top().key;
+                        heap.push(entry);
+                        if (best)
+                        {
+                            bestPoint = v;
+                            bestTriangle = entry.triangle;
+                            break;
+                        }
+                    }
+                }
+
+                // add the point
+                ret.push_back({ c, bestPoint });
+                layers[c].sampleCount++;
+                grids[c].AddPoint((int)ret.size() - 1, bestPoint[0], bestPoint[1]);
+
+                // every new triangle goes in the heap of every class, keyed by the smallest bound its vertices give
+                triangulation.AddPoint(bestPoint, bestTriangle,
+                    [&](int triangle)
+                    {
+                        if (!triangulation.IsCanonical(triangle))
+                            return;
+
+                        const PeriodicDelaunay::Triangle& t = triangulation.GetTriangle(triangle);
+                        float circumRadius = triangulation.CircumRadius(triangle);
+                        for (int classIndex = 0; classIndex < N; ++classIndex)
+                        {
+                            float key = FLT_MAX;
+                            for (int i = 0; i < 3; ++i)
+                            {
+                                float r = rMatrix[classIndex][ret[triangulation.VertexPoint(t.v[i])].classIndex];
+                                if (r > 0.0f)
+                                    key = std::min(key, circumRadius / r);
+                            }
+                            heaps[classIndex].push({ key, triangle, t.version });
+                        }
+                    }
+                );
+            }
+        }
+        printf("\r100%%\n");
+
+        // unsort the classes, so they are in the same order that the user asked for
+        for (Point& p : ret)
+            p.classIndex = layers[p.classIndex].originalIndex;
+
+        return ret;
+    }
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Grid.h"
+#include "Soft.h"
+#include "ThreadPool.h"
+
+// Optimizes a multi class point set by gradient descent on the energy that Soft::Make scores candidates with:
+// the sum over pairs of points of exp(-d^2 / (2 sigma^2)), where sigma = 0.25 * rMatrix[c][j] for a point of class c
+// and one of class j, truncated at 3 sigma. Any generator's points can be the starting point.
+//
+// Each iteration finds every point's energy gradient from its neighbors in the grids, in parallel, with the
+// Gaussians done 8 at a time by Soft's fast kernel. Points move along their gradient scaled by the square of their own
+// class's sigma, so that every class moves a similar fraction of its spacing, and by at most maxMove of that sigma.
+// If the total energy goes up, the step is undone and the step size halved, otherwise the step size grows.
+//
+// The Gaussians are short range, and flat at their centers, so it works best from points that are already well spread
+// out. Points that start on top of each other, as white noise can have, barely push each other apart.
+
+namespace GradientDescent
+{
+    struct Settings
+    {
+        int maxIterations = 100;
+
+        // stop when an iteration lowers the energy by less than this fraction of it
+        float convergenceThreshold = 1e-4f;
+
+        float stepSize = 0.5f;
+
+        // the furthest a point can move in one iteration, as a multiple of its own class's sigma
+        float maxMove = 0.5f;
+
+        bool toroidal = true;
+        bool multithreaded = true;
+    };
+
+    // neighbor offsets and the pair's -1/(2 sigma^2) and 1/sigma^2, gathered for one point
+    struct Scratch
+    {
+        std::vector<int> neighbors;
+        std::vector<float> dx;
+        std::vector<float> dy;
+        std::vector<float> scale;
+        std::vector<float> inverseSigmaSq;
+    };
+
+    // Sums the Gaussians of the gathered neighbors, and their gradient with respect to the point
+    inline void SumGaussiansAndGradients(const Scratch& scratch, float& energy, float& gradientX, float& gradientY)
+    {
+        int count = (int)scratch.dx.size();
+        int i = 0;
+        energy = 0.0f;
+        gradientX = 0.0f;
+        gradientY = 0.0f;
+
+#if defined(__AVX2__)
+        __m256 energy8 = _mm256_setzero_ps();
+        __m256 gradientX8 = _mm256_setzero_ps();
+        __m256 gradientY8 = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 dx = _mm256_loadu_ps(&scratch.dx[i]);
+            __m256 dy = _mm256_loadu_ps(&scratch.dy[i]);
+            __m256 distSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+            __m256 g = Soft::FastExp8(_mm256_mul_ps(distSq, _mm256_loadu_ps(&scratch.scale[i])));
+            __m256 weight = _mm256_mul_ps(g, _mm256_loadu_ps(&scratch.inverseSigmaSq[i]));
+            energy8 = _mm256_add_ps(energy8, g);
+            gradientX8 = _mm256_add_ps(gradientX8, _mm256_mul_ps(weight, dx));
+            gradientY8 = _mm256_add_ps(gradientY8, _mm256_mul_ps(weight, dy));
+        }
+
+        alignas(32) float sums[3][8];
+        _mm256_store_ps(sums[0], energy8);
+        _mm256_store_ps(sums[1], gradientX8);
+        _mm256_store_ps(sums[2], gradientY8);
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            energy += sums[0][lane];
+            gradientX += sums[1][lane];
+            gradientY += sums[2][lane];
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            float distSq = scratch.dx[i] * scratch.dx[i] + scratch.dy[i] * scratch.dy[i];
+            float g = Soft::FastExp(distSq * scratch.scale[i]);
+            float weight = g * scratch.inverseSigmaSq[i];
+            energy += g;
+            gradientX += weight * scratch.dx[i];
+            gradientY += weight * scratch.dy[i];
+        }
+    }
+
+    inline std::vector<Point> Optimize(const std::vector<Point>& points, const Settings& settings = Settings())
+    {
+        // points with no class (a negative class index) don't take part, and are carried through unmoved
+        std::vector<Point> ret;
+        std::vector<int> retIndices;
+        ret.reserve(points.size());
+        retIndices.reserve(points.size());
+        for (int i = 0; i < (int)points.size(); ++i)
+        {
+            if (points[i].classIndex >= 0)
+            {
+                ret.push_back(points[i]);
+                retIndices.push_back(i);
+            }
+        }
+        if (ret.size() < points.size())
+            printf("GradientDescent::Optimize(): leaving %i points with no class where they are\n", int(points.size() - ret.size()));
+
+        // count the classes
+        int classCount = 0;
+        for (const Point& p : ret)
+            classCount = std::max(classCount, p.classIndex + 1);
+        std::vector<int> counts(classCount, 0);
+        for (const Point& p : ret)
+            counts[p.classIndex]++;
+
+        // make the layer data, sorted from largest to smallest radius
+        std::vector<Soft::Layer> layers(classCount);
+        for (int i = 0; i < classCount; ++i)
+        {
+            float packing_density = c_pi * std::sqrt(3.0f) / 6.0f;
+            layers[i].radius = (counts[i] > 0) ? 2.0f * std::pow(packing_density / (c_pi * float(counts[i])), 1.0f / 2.0f) : 0.0f;
+            layers[i].originalIndex = i;
+            layers[i].targetCount = counts[i];
+        }
+        std::sort(
+            layers.begin(),
+            layers.end(),
+            [](const Soft::Layer& A, const Soft::Layer& B)
+            {
+                return A.radius > B.radius;
+            }
+        );
+
+        // Make the r matrix, indexed by the classes of the points rather than the sorted layers
+        std::vector<std::vector<float>> rMatrix(classCount, std::vector<float>(classCount, 0.0f));
+        {
+            for (int i = 0; i < classCount; ++i)
+                rMatrix[layers[i].originalIndex][layers[i].originalIndex] = layers[i].radius;
+
+            int classStartIndex = -1;
+            int classEndIndex = 0;
+            float totalDensity = 0.0f;
+            while (true)
+            {
+                classStartIndex = classEndIndex;
+                if (classStartIndex >= classCount || layers[classStartIndex].targetCount == 0)
+                    break;
+
+                while (classEndIndex < classCount && layers[classEndIndex].radius == layers[classStartIndex].radius)
+                    classEndIndex++;
+
+                for (int i = classStartIndex; i < classEndIndex; ++i)
+                    totalDensity += 1.0f / (layers[i].radius * layers[i].radius);
+
+                for (int i = classStartIndex; i < classEndIndex; ++i)
+                {
+                    for (int j = 0; j < classStartIndex; ++j)
+                    {
+                        int a = layers[i].originalIndex;
+                        int b = layers[j].originalIndex;
+                        rMatrix[a][b] = rMatrix[b][a] = 1.0f / std::sqrt(totalDensity);
+                    }
+                }
+            }
+        }
+
+        // The sigma of each class pair, and the -1/(2 sigma^2) that the fast kernel multiplies by
+        std::vector<std::vector<float>> sigmaMatrix(classCount, std::vector<float>(classCount, 0.0f));
+        std::vector<std::vector<float>> scaleMatrix(classCount, std::vector<float>(classCount, 0.0f));
+        for (int i = 0; i < classCount; ++i)
+        {
+            for (int j = 0; j < classCount; ++j)
+            {
+                sigmaMatrix[i][j] = 0.25f * rMatrix[i][j];
+                if (sigmaMatrix[i][j] > 0.0f)
+                    scaleMatrix[i][j] = -1.0f / (2.0f * sigmaMatrix[i][j] * sigmaMatrix[i][j]);
+            }
+        }
+
+        ThreadPool& threadPool = GetThreadPool();
+        std::vector<Scratch> scratch(settings.multithreaded ? threadPool.ThreadCount() : 1);
+        std::vector<Vec2> gradients(ret.size());
+        std::vector<float> energies(ret.size());
+        std::vector<Point> lastPoints;
+
+        // Calculates the gradients and energies of all points, returning the total energy
+        auto CalculateGradients = [&]()
+        {
+            std::vector<Grid<100, 100>> grids(classCount);
+            for (int i = 0; i < (int)ret.size(); ++i)
+                grids[ret[i].classIndex].AddPoint(i, ret[i].v[0], ret[i].v[1]);
+
+            auto DoPoint = [&](int index, int threadIndex)
+            {
+                Scratch& s = scratch[threadIndex];
+                s.dx.clear();
+                s.dy.clear();
+                s.scale.clear();
+                s.inverseSigmaSq.clear();
+
+                const Vec2& p = ret[index].v;
+                int c = ret[index].classIndex;
+                for (int j = 0; j < classCount; ++j)
+                {
+                    float sigma = sigmaMatrix[c][j];
+                    if (sigma <= 0.0f)
+                        continue;
+
+                    if (settings.toroidal)
+                        grids[j].GetPoints<true>(p[0], p[1], 3.0f * sigma, s.neighbors, false, false);
+                    else
+                        grids[j].GetPoints<false>(p[0], p[1], 3.0f * sigma, s.neighbors, false, false);
+
+                    for (int neighborIndex : s.neighbors)
+                    {
+                        if (neighborIndex == index)
+                            continue;
+
+                        // the offset from the neighbor to the point, which is the direction that lowers the energy
+                        float dx = p[0] - ret[neighborIndex].v[0];
+                        float dy = p[1] - ret[neighborIndex].v[1];
+                        if (settings.toroidal)
+                        {
+                            dx -= std::round(dx);
+                            dy -= std::round(dy);
+                        }
+                        s.dx.push_back(dx);
+                        s.dy.push_back(dy);
+                        s.scale.push_back(scaleMatrix[c][j]);
+                        s.inverseSigmaSq.push_back(1.0f / (sigma * sigma));
+                    }
+                }
+
+                float energy, gradientX, gradientY;
+                SumGaussiansAndGradients(s, energy, gradientX, gradientY);
+                energies[index] = energy;
+                gradients[index] = Vec2{ gradientX, gradientY };
+            };
+
+            if (settings.multithreaded)
+                threadPool.ParallelFor((int)ret.size(), DoPoint, 256);
+            else
+            {
+                for (int i = 0; i < (int)ret.size(); ++i)
+                    DoPoint(i, 0);
+            }
+
+            double totalEnergy = 0.0;
+            for (float energy : energies)
+                totalEnergy += energy;
+            return totalEnergy;
+        };
+
+        // Moves every point down its gradient
+        auto Step = [&](float stepSize)
+        {
+            auto DoPoint = [&](int index, int threadIndex)
+            {
+                Point& p = ret[index];
+                float sigma = sigmaMatrix[p.classIndex][p.classIndex];
+                float moveX = gradients[index][0] * stepSize * sigma * sigma;
+                float moveY = gradients[index][1] * stepSize * sigma * sigma;
+
+                float maxMove = settings.maxMove * sigma;
+                float moveSq = moveX * moveX + moveY * moveY;
+                if (moveSq > maxMove * maxMove)
+                {
+                    float scale = maxMove / std::sqrt(moveSq);
+                    moveX *= scale;
+                    moveY *= scale;
+                }
+
+                p.v[0] += moveX;
+                p.v[1] += moveY;
+                for (float& f : p.v)
+                {
+                    if (settings.toroidal)
+                        f -= std::floor(f);
+                    f = Clamp(f, 0.0f, 0.99999994f);
+                }
+            };
+
+            if (settings.multithreaded)
+                threadPool.ParallelFor((int)ret.size(), DoPoint, 1024);
+            else
+            {
+                for (int i = 0; i < (int)ret.size(); ++i)
+                    DoPoint(i, 0);
+            }
+        };
+
+        // gradient descent, undoing steps that make the energy worse
+        float stepSize = settings.stepSize;
+        double energy = CalculateGradients();
+        double startEnergy = energy;
+        std::vector<Vec2> lastGradients;
+        int iteration = 0;
+        for (; iteration < settings.maxIterations && !ret.empty(); ++iteration)
+        {
+            lastPoints = ret;
+            lastGradients = gradients;
+            Step(stepSize);
+
+            double newEnergy = CalculateGradients();
+            if (newEnergy > energy)
+            {
+                ret.swap(lastPoints);
+                gradients.swap(lastGradients);
+                stepSize *= 0.5f;
+            }
+            else
+            {
+                bool converged = (energy - newEnergy) < double(settings.convergenceThreshold) * energy;
+                energy = newEnergy;
+                stepSize *= 1.2f;
+                if (converged)
+                {
+                    iteration++;
+                    break;
+                }
+            }
+
+            printf("\rGradient descent iteration %i: energy %f", iteration + 1, float(energy / 2.0));
+        }
+        printf("\rGradient descent: %i iterations, energy %f -> %f\n", iteration, float(startEnergy / 2.0), float(energy / 2.0));
+
+        std::vector<Point> output = points;
+        for (int i = 0; i < (int)ret.size(); ++i)
+            output[retIndices[i]] = ret[i];
+        return output;
+    }
+};
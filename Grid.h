@@ -116,6 +116,18 @@ public:
         }
     }
 
+    // Gets the points in a cell. Cell coordinates out of range wrap around.
+    void GetCellPoints(int cx, int cy, std::vector<int>& results, bool append = true) const
+    {
+        if (!append)
+            results.clear();
+
+        cx = ((cx % (int)CELLSX) + (int)CELLSX) % (int)CELLSX;
+        cy = ((cy % (int)CELLSY) + (int)CELLSY) % (int)CELLSY;
+        for (const auto& p : m_cells[cx][cy])
+            results.push_back(p.index);
+    }
+
     void AddPoint(int index, float x, float y)
     {
         int cx = XToCellX(x);
@@ -123,6 +135,16 @@ public:
         m_cells[cx][cy].push_back({ index, x, y });
     }
 
+    // Removes all points, keeping the memory for reuse
+    void Clear()
+    {
+        for (auto& col : m_cells)
+        {
+            for (auto& cell : col)
+                cell.clear();
+        }
+    }
+
     void RemovePoint(int index)
     {
         // not super efficient but shrug
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Grid.h"
+#include "PointFile.h"
 
 namespace Hard
 {
@@ -12,15 +13,10 @@ namespace Hard
         int targetCount = 0;
     };
 
-    template <size_t N, typename RNG>
-    std::vector<Point> Make(const float(&radii)[N], int targetCount, RNG& rng, bool toroidal)
+    // Makes the layers, sorted from largest to smallest radius, with targetCount split between them by density
+    template <size_t N>
+    std::vector<Layer> MakeLayers(const float(&radii)[N], int targetCount)
     {
-        const int c_failCountFatal = targetCount * 20;
-        const int c_failCountRemove = targetCount / 10;
-
-        std::vector<Grid<100,100>> grids(N);
-
-        // sort the layers from largest to smallest radius
         std::vector<Layer> layers(N);
         for (int i = 0; i < N; ++i)
         {
@@ -49,136 +45,181 @@ namespace Hard
             }
         }
 
-        // Make the r matrix
+        return layers;
+    }
+
+    // Makes the r matrix from layers sorted by MakeLayers()
+    template <size_t N>
+    std::array<std::array<float, N>, N> MakeRMatrix(const std::vector<Layer>& layers)
+    {
         std::array<std::array<float, N>, N> rMatrix;
+        for (int i = 0; i < N; ++i)
         {
-            for (int i = 0; i < N; ++i)
-            {
-                std::fill(rMatrix[i].begin(), rMatrix[i].end(), 0.0f);
-                rMatrix[i][i] = layers[i].radius;
-            }
+            std::fill(rMatrix[i].begin(), rMatrix[i].end(), 0.0f);
+            rMatrix[i][i] = layers[i].radius;
+        }
 
-            int classStartIndex = -1;
-            int classEndIndex = 0;
-            float totalDensity = 0.0f;
-            while (true)
-            {
-                classStartIndex = classEndIndex;
-                if (classStartIndex >= N)
-                    break;
+        int classStartIndex = -1;
+        int classEndIndex = 0;
+        float totalDensity = 0.0f;
+        while (true)
+        {
+            classStartIndex = classEndIndex;
+            if (classStartIndex >= N)
+                break;
 
-                while (classEndIndex < N && layers[classEndIndex].radius == layers[classStartIndex].radius)
-                    classEndIndex++;
+            while (classEndIndex < N && layers[classEndIndex].radius == layers[classStartIndex].radius)
+                classEndIndex++;
 
-                for (int i = classStartIndex; i < classEndIndex; ++i)
-                    totalDensity += 1.0f / (layers[i].radius * layers[i].radius);
+            for (int i = classStartIndex; i < classEndIndex; ++i)
+                totalDensity += 1.0f / (layers[i].radius * layers[i].radius);
 
-                for (int i = classStartIndex; i < classEndIndex; ++i)
-                {
-                    for (int j = 0; j < classStartIndex; ++j)
-                        rMatrix[i][j] = rMatrix[j][i] = 1.0f / std::sqrt(totalDensity);
-                }
+            for (int i = classStartIndex; i < classEndIndex; ++i)
+            {
+                for (int j = 0; j < classStartIndex; ++j)
+                    rMatrix[i][j] = rMatrix[j][i] = 1.0f / std::sqrt(totalDensity);
             }
         }
+        return rMatrix;
+    }
 
-        // Make the points!
-        std::vector<Point> ret;
+    // Finds the points that a new point of class classIndex would conflict with, using the grids.
+    // If stopAfterFirst is true, it only finds out whether there is a conflict.
+    template <size_t N>
+    void FindConflicts(const Vec2& point, int classIndex, const std::vector<Grid<100, 100>>& grids, const std::array<std::array<float, N>, N>& rMatrix, bool toroidal, bool stopAfterFirst, std::vector<int>& conflicts)
+    {
+        conflicts.clear();
+        for (int i = 0; i < N; ++i)
         {
-            int pointsRemoved = 0;
-            int lastPercent = -1;
-            int failCount = 0;
-            while (ret.size() < targetCount && pointsRemoved < targetCount)
+            if (stopAfterFirst && !conflicts.empty())
+                break;
+            if (toroidal)
+                grids[i].GetPoints<true>(point[0], point[1], rMatrix[i][classIndex], conflicts, stopAfterFirst, true);
+            else
+                grids[i].GetPoints<false>(point[0], point[1], rMatrix[i][classIndex], conflicts, stopAfterFirst, true);
+        }
+    }
+
+    // Adds points to ret by dart throwing, until there are targetCount, or it fails more than failCountFatal times in a row.
+    // ret can start with points in it, which must already be in the grids and counted in the layers' sampleCounts.
+    // Every so often a point is taken anyways, and the conflicting points are removed, if they are in classes that
+    // are at least as full and at least as sparse.
+    template <size_t N, typename RNG>
+    void Fill(std::vector<Point>& ret, std::vector<Layer>& layers, const std::array<std::array<float, N>, N>& rMatrix, std::vector<Grid<100, 100>>& grids, int targetCount, int failCountFatal, RNG& rng, bool toroidal)
+    {
+        const int c_failCountRemove = std::max(targetCount / 10, 1);
+
+        int pointsRemoved = 0;
+        int lastPercent = -1;
+        int failCount = 0;
+        while (ret.size() < targetCount && pointsRemoved < targetCount)
+        {
+            int percent = int(100.0f * std::max(float(ret.size()) / float(targetCount), float(pointsRemoved) / float(targetCount)));
+            if (percent != lastPercent)
             {
-                int percent = int(100.0f * std::max(float(ret.size()) / float(targetCount), float(pointsRemoved) / float(targetCount)));
-                if (percent != lastPercent)
-                {
-                    printf("\r%i%%", percent);
-                    lastPercent = percent;
-                }
+                printf("\r%i%%", percent);
+                lastPercent = percent;
+            }
 
-                // find the class which is least filled.
-                float leastPercent = FLT_MAX;
-                int leastPercentClass = -1;
-                for (int i = 0; i < N; ++i)
+            // find the class which is least filled.
+            float leastPercent = FLT_MAX;
+            int leastPercentClass = -1;
+            for (int i = 0; i < N; ++i)
+            {
+                float percent = float(layers[i].sampleCount) / float(layers[i].targetCount);
+                if (percent < leastPercent)
                 {
-                    float percent = float(layers[i].sampleCount) / float(layers[i].targetCount);
-                    if (percent < leastPercent)
-                    {
-                        leastPercent = percent;
-                        leastPercentClass = i;
-                    }
+                    leastPercent = percent;
+                    leastPercentClass = i;
                 }
+            }
 
-                // Calculate a random point and accept it if it satisfies all constraints
-                // Every so often, take it anyways, and destroy the conflicting points (with some more logic)
-                Vec2 point = rng();
-                std::vector<int> conflicts;
-                float newClassPercent = float(layers[leastPercentClass].sampleCount) / float(layers[leastPercentClass].targetCount);
-                bool considerRemoval = ((failCount + 1) % c_failCountRemove) == 0;
-
-                // find conflicting points using the grids
-                // If we are considering removal, we want all conflicts
-                // otherwise we only need 1 point to know that there was a conflict
-                for (int i = 0; i < N; ++i)
-                {
-                    if (toroidal)
-                        grids[i].GetPoints<true>(point[0], point[1], rMatrix[i][leastPercentClass], conflicts, !considerRemoval, true);
-                    else
-                        grids[i].GetPoints<false>(point[0], point[1], rMatrix[i][leastPercentClass], conflicts, !considerRemoval, true);
-                }
+            // Calculate a random point and accept it if it satisfies all constraints
+            // Every so often, take it anyways, and destroy the conflicting points (with some more logic)
+            Vec2 point = rng();
+            std::vector<int> conflicts;
+            float newClassPercent = float(layers[leastPercentClass].sampleCount) / float(layers[leastPercentClass].targetCount);
+            bool considerRemoval = ((failCount + 1) % c_failCountRemove) == 0;
 
-                if (conflicts.size() == 0)
-                {
-                    failCount = 0;
-                    ret.push_back({ leastPercentClass, point });
-                    layers[leastPercentClass].sampleCount++;
-                    grids[leastPercentClass].AddPoint((int)ret.size() - 1, point[0], point[1]);
-                }
-                else
+            // find conflicting points using the grids
+            // If we are considering removal, we want all conflicts
+            // otherwise we only need 1 point to know that there was a conflict
+            FindConflicts(point, leastPercentClass, grids, rMatrix, toroidal, !considerRemoval, conflicts);
+
+            if (conflicts.size() == 0)
+            {
+                failCount = 0;
+                ret.push_back({ leastPercentClass, point });
+                layers[leastPercentClass].sampleCount++;
+                grids[leastPercentClass].AddPoint((int)ret.size() - 1, point[0], point[1]);
+            }
+            else
+            {
+                failCount++;
+
+                if (considerRemoval)
                 {
-                    failCount++;
+                    // see if it's safe to remove all of the points or not
+                    for (int pointIndex : conflicts)
+                    {
+                        int classIndex = ret[pointIndex].classIndex;
+                        considerRemoval = considerRemoval &&
+                            (float(layers[classIndex].sampleCount) / float(layers[classIndex].targetCount) >= newClassPercent) &&
+                            (layers[classIndex].radius >= layers[leastPercentClass].radius);
+                        if (!considerRemoval)
+                            break;
+                    }
 
                     if (considerRemoval)
                     {
-                        // see if it's safe to remove all of the points or not
+                        // sort highest to lowest so we don't invalidate the indices we are removing
+                        std::sort(conflicts.begin(), conflicts.end(), [](int a, int b) { return b < a; });
+
+                        float layerPercent = float(layers[leastPercentClass].sampleCount) / float(layers[leastPercentClass].targetCount);
                         for (int pointIndex : conflicts)
                         {
-                            int classIndex = ret[pointIndex].classIndex;
-                            considerRemoval = considerRemoval &&
-                                (float(layers[classIndex].sampleCount) / float(layers[classIndex].targetCount) >= newClassPercent) &&
-                                (layers[classIndex].radius >= layers[leastPercentClass].radius);
-                            if (!considerRemoval)
-                                break;
-                        }
+                            if (pointIndex < 0 || pointIndex >= ret.size())
+                                printf("ERROR! pointIndex = %i.  ret.size() = %i\n", pointIndex, (int)ret.size());
+                            layers[ret[pointIndex].classIndex].sampleCount--;
+                            ret.erase(ret.begin() + pointIndex);
 
-                        if (considerRemoval)
-                        {
-                            // sort highest to lowest so we don't invalidate the indices we are removing
-                            std::sort(conflicts.begin(), conflicts.end(), [](int a, int b) { return b < a; });
-
-                            float layerPercent = float(layers[leastPercentClass].sampleCount) / float(layers[leastPercentClass].targetCount);
-                            for (int pointIndex : conflicts)
-                            {
-                                if (pointIndex < 0 || pointIndex >= ret.size())
-                                    printf("ERROR! pointIndex = %i.  ret.size() = %i\n", pointIndex, (int)ret.size());
-                                layers[ret[pointIndex].classIndex].sampleCount--;
-                                ret.erase(ret.begin() + pointIndex);
-
-                                // All grids need to be updated to know this point was removed.
-                                // Any index > this is invalid unless it is decrimented
-                                for (int classIndex = 0; classIndex < N; ++classIndex)
-                                    grids[classIndex].RemovePoint(pointIndex);
-
-                                pointsRemoved++;
-                            }
+                            // All grids need to be updated to know this point was removed.
+                            // Any index > this is invalid unless it is decrimented
+                            for (int classIndex = 0; classIndex < N; ++classIndex)
+                                grids[classIndex].RemovePoint(pointIndex);
+
+                            pointsRemoved++;
                         }
                     }
-                    else if (failCount > c_failCountFatal)
-                        break;
                 }
+                else if (failCount > failCountFatal)
+                    break;
             }
         }
         printf("\r100%%\n");
+    }
+
+    // If info is given, it gets the r matrix and the parameters, to save with the points
+    template <size_t N, typename RNG>
+    std::vector<Point> Make(const float(&radii)[N], int targetCount, RNG& rng, bool toroidal, PointFile::Info* info = nullptr)
+    {
+        std::vector<Grid<100,100>> grids(N);
+
+        std::vector<Layer> layers = MakeLayers(radii, targetCount);
+        std::array<std::array<float, N>, N> rMatrix = MakeRMatrix<N>(layers);
+
+        // Make the points!
+        std::vector<Point> ret;
+        Fill(ret, layers, rMatrix, grids, targetCount, targetCount * 20, rng, toroidal);
+
+        if (info)
+        {
+            info->rMatrix = PointFile::UnsortRMatrix(rMatrix, layers);
+            info->params = "Hard::Make";
+            PointFile::AppendParam(info->params, "radii", radii);
+            PointFile::AppendParam(info->params, "targetCount", targetCount);
+            PointFile::AppendParam(info->params, "toroidal", toroidal ? 1 : 0);
+        }
 
         // unsort the layers, so they are in the same order that the user asked for
         for (int i = 0; i < N; ++i)
@@ -205,4 +246,94 @@ namespace Hard
 
         return ret;
     }
+
+    // Repairs a point set made with different radii or a different targetCount, instead of making a new one.
+    // Points are kept from the sparsest class to the densest, dropping any that conflict with the points kept
+    // before them under the new r matrix, or that are more than their class's new target count. Then the dart
+    // throwing loop fills the space, with every other candidate taken from near a dropped point, since that is
+    // where the space was freed. It gives up after failing 20 times per dropped point in a row, instead of 20 times per
+    // target point, so that small changes cost a small part of what Make() does. Space that a smaller radius frees
+    // away from dropped points only gets the uniform candidates, so big changes are better made from scratch.
+    template <size_t N, typename RNG>
+    std::vector<Point> Repair(const std::vector<Point>& points, const float(&radii)[N], int targetCount, RNG& rng, bool toroidal)
+    {
+        std::vector<Grid<100, 100>> grids(N);
+
+        std::vector<Layer> layers = MakeLayers(radii, targetCount);
+        std::array<std::array<float, N>, N> rMatrix = MakeRMatrix<N>(layers);
+
+        // the sorted layer of each class that the user gave
+        std::array<int, N> classLayer;
+        for (int i = 0; i < N; ++i)
+            classLayer[layers[i].originalIndex] = i;
+
+        // keep the points that still fit, sparsest classes first
+        std::vector<Point> ret;
+        std::vector<Vec2> droppedPoints;
+        {
+            std::vector<int> order;
+            for (int i = 0; i < (int)points.size(); ++i)
+            {
+                if (points[i].classIndex >= 0 && points[i].classIndex < N)
+                    order.push_back(i);
+            }
+            std::stable_sort(order.begin(), order.end(),
+                [&](int A, int B)
+                {
+                    return classLayer[points[A].classIndex] < classLayer[points[B].classIndex];
+                }
+            );
+
+            std::vector<int> conflicts;
+            for (int pointIndex : order)
+            {
+                int classIndex = classLayer[points[pointIndex].classIndex];
+                const Vec2& point = points[pointIndex].v;
+                FindConflicts(point, classIndex, grids, rMatrix, toroidal, true, conflicts);
+                if (conflicts.size() > 0 || layers[classIndex].sampleCount >= layers[classIndex].targetCount)
+                {
+                    droppedPoints.push_back(point);
+                    continue;
+                }
+
+                ret.push_back({ classIndex, point });
+                layers[classIndex].sampleCount++;
+                grids[classIndex].AddPoint((int)ret.size() - 1, point[0], point[1]);
+            }
+        }
+        int keptCount = (int)ret.size();
+
+        // every other candidate is near a dropped point, within the largest radius
+        float nearRadius = layers[0].radius;
+        bool nearDropped = false;
+        auto RepairRNG = [&]()
+        {
+            Vec2 point = rng();
+            nearDropped = !nearDropped;
+            if (!nearDropped || droppedPoints.empty())
+                return point;
+
+            Vec2 offset = rng();
+            const Vec2& dropped = droppedPoints[std::min(int(point[0] * float(droppedPoints.size())), (int)droppedPoints.size() - 1)];
+            for (int i = 0; i < 2; ++i)
+            {
+                point[i] = dropped[i] + (offset[i] * 2.0f - 1.0f) * nearRadius;
+                if (toroidal)
+                    point[i] -= std::floor(point[i]);
+                point[i] = Clamp(point[i], 0.0f, 0.99999994f);
+            }
+            return point;
+        };
+
+        int failCountFatal = (int)droppedPoints.size() * 20 + 1000;
+        Fill(ret, layers, rMatrix, grids, targetCount, failCountFatal, RepairRNG, toroidal);
+
+        printf("Repair: kept %i points, dropped %i, made %i\n", keptCount, (int)droppedPoints.size(), (int)ret.size() - keptCount);
+
+        // the classes in the order that the user asked for
+        for (Point& p : ret)
+            p.classIndex = layers[p.classIndex].originalIndex;
+
+        return ret;
+    }
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Grid.h"
+#include "PointFile.h"
 
 namespace HardAdaptive
 {
@@ -63,8 +64,10 @@ namespace HardAdaptive
         stbi_image_free(pixelsu8);
     }
 
+    // If info is given, it gets the parameters, and the r matrix of each layer's expected radius, since the real one
+    // changes over the image
     template <size_t N, typename RNG>
-    std::vector<Point> Make(const LayerParam(&layers_)[N], int imageW, int imageH, int targetCount, RNG& rng)
+    std::vector<Point> Make(const LayerParam(&layers_)[N], int imageW, int imageH, int targetCount, RNG& rng, PointFile::Info* info = nullptr)
     {
         const int c_failCountFatal = targetCount * 20;
         const int c_failCountRemove = targetCount / 10;
@@ -251,6 +254,39 @@ namespace HardAdaptive
         }
         printf("\r100%%\n");
 
+        if (info)
+        {
+            // the same r matrix as each pixel gets, but from the expected radii
+            typedef std::array<std::array<float, N>, N> TrMatrix;
+            TrMatrix rMatrix;
+            float totalDensity = 0.0f;
+            for (int i = 0; i < N; ++i)
+            {
+                std::fill(rMatrix[i].begin(), rMatrix[i].end(), 0.0f);
+                rMatrix[i][i] = layers[i].imageExpectedRadius;
+                totalDensity += 1.0f / (layers[i].imageExpectedRadius * layers[i].imageExpectedRadius);
+                for (int j = 0; j < i; ++j)
+                    rMatrix[i][j] = rMatrix[j][i] = 1.0f / std::sqrt(totalDensity);
+            }
+            info->rMatrix = PointFile::UnsortRMatrix(rMatrix, layers);
+
+            float rmin[N];
+            float rmax[N];
+            info->params = "HardAdaptive::Make images=";
+            for (int i = 0; i < N; ++i)
+            {
+                info->params += (i > 0) ? "," : "";
+                info->params += layers_[i].imageFileName;
+                rmin[i] = layers_[i].rmin;
+                rmax[i] = layers_[i].rmax;
+            }
+            PointFile::AppendParam(info->params, "rmin", rmin);
+            PointFile::AppendParam(info->params, "rmax", rmax);
+            PointFile::AppendParam(info->params, "imageW", imageW);
+            PointFile::AppendParam(info->params, "imageH", imageH);
+            PointFile::AppendParam(info->params, "targetCount", targetCount);
+        }
+
         // unsort the layers, so they are in the same order that the user asked for
         for (int i = 0; i < N; ++i)
         {
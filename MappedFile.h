@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read only memory mapped file. Empty files open fine, with no data.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const char* fileName)
+    {
+        Close();
+
+#if defined(_WIN32)
+        m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        GetFileSizeEx(m_file, &size);
+        m_size = uint64_t(size.QuadPart);
+        if (m_size == 0)
+            return true;
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping)
+            m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        m_file = open(fileName, O_RDONLY);
+        if (m_file < 0)
+            return false;
+
+        struct stat fileStat;
+        fstat(m_file, &fileStat);
+        m_size = uint64_t(fileStat.st_size);
+        if (m_size == 0)
+            return true;
+
+        void* data = mmap(nullptr, size_t(m_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+        m_data = (data == MAP_FAILED) ? nullptr : (const unsigned char*)data;
+#endif
+        if (!m_data)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data)
+            munmap((void*)m_data, size_t(m_size));
+        if (m_file >= 0)
+            close(m_file);
+        m_file = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const unsigned char* Data() const
+    {
+        return m_data;
+    }
+
+    uint64_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    const unsigned char* m_data = nullptr;
+    uint64_t m_size = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+// Quality metrics for multi class point sets
+
+namespace Metrics
+{
+    struct NearestNeighborStats
+    {
+        int count = 0;
+        float minDistance = 0.0f;
+        float meanDistance = 0.0f;
+
+        // distances divided by the spacing of a hexagonal packing of the same number of points,
+        // so that sets of different sizes can be compared. Well distributed blue noise has a
+        // normalized minimum around 0.75 or higher, while white noise is near 0.
+        float normalizedMin = 0.0f;
+        float normalizedMean = 0.0f;
+    };
+
+    inline NearestNeighborStats CalculateNearestNeighborStats(const std::vector<Vec2>& points, bool toroidal)
+    {
+        NearestNeighborStats ret;
+        ret.count = (int)points.size();
+        if (points.size() < 2)
+            return ret;
+
+        float minDistanceSq = FLT_MAX;
+        double sumDistance = 0.0;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            float nearestSq = FLT_MAX;
+            for (size_t j = 0; j < points.size(); ++j)
+            {
+                if (i == j)
+                    continue;
+                float distSq = toroidal ? ToroidalDistanceSq(points[i], points[j]) : DistanceSq(points[i], points[j]);
+                nearestSq = std::min(nearestSq, distSq);
+            }
+            minDistanceSq = std::min(minDistanceSq, nearestSq);
+            sumDistance += std::sqrt(nearestSq);
+        }
+
+        ret.minDistance = std::sqrt(minDistanceSq);
+        ret.meanDistance = float(sumDistance / double(points.size()));
+
+        float hexSpacing = std::sqrt(2.0f / (std::sqrt(3.0f) * float(points.size())));
+        ret.normalizedMin = ret.minDistance / hexSpacing;
+        ret.normalizedMean = ret.meanDistance / hexSpacing;
+        return ret;
+    }
+
+    // Returns stats for each class, followed by stats for all classes together
+    inline std::vector<NearestNeighborStats> CalculateNearestNeighborStats(const std::vector<Point>& points, bool toroidal)
+    {
+        std::vector<std::vector<Vec2>> classPoints;
+        std::vector<Vec2> allPoints;
+        for (const Point& p : points)
+        {
+            if (p.classIndex >= classPoints.size())
+                classPoints.resize(p.classIndex + 1);
+            classPoints[p.classIndex].push_back(p.v);
+            allPoints.push_back(p.v);
+        }
+
+        std::vector<NearestNeighborStats> ret;
+        for (const std::vector<Vec2>& classPoint : classPoints)
+            ret.push_back(CalculateNearestNeighborStats(classPoint, toroidal));
+        ret.push_back(CalculateNearestNeighborStats(allPoints, toroidal));
+        return ret;
+    }
+
+    inline void PrintNearestNeighborStats(const std::vector<NearestNeighborStats>& stats)
+    {
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            if (i + 1 < stats.size())
+                printf("  class %i", (int)i);
+            else
+                printf("  all    ");
+            printf(" : %i points, normalized NN distance min %0.3f mean %0.3f\n", stats[i].count, stats[i].normalizedMin, stats[i].normalizedMean);
+        }
+    }
+};
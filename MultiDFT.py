@@ -189,7 +189,8 @@ else:
         fileName = fileNameBase.replace("%i", str(i))
 
         print(fileName)
-        im = np.array(Image.open(fileName), dtype=float) / 255.0
+        # 1 bit images are converted to 0 and 255
+        im = np.array(Image.open(fileName).convert("L"), dtype=float) / 255.0
 
         if len(im.shape) == 3 and im.shape[2] != 1:
             sys.exit(fileName + " is not a single channel image. Script needs to be modified to support it");
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PointFile.h"
+
+// Writes finished point sets to disk in the background, so the next point set can be made while the last is written.
+//
+// Each output format is a sink: a named function that writes one point set. Sinks can be turned on and off by name.
+// Submit() hands a point set to the pipeline, and every enabled sink becomes a work item that the writer threads
+// pick up, so the formats of a point set are written in parallel with each other, and with the caller.
+// At most maxQueuedJobs point sets are held at once. Submit() waits for one to finish when that many are in flight,
+// which keeps memory bounded when the caller makes point sets faster than they can be written.
+
+class OutputPipeline
+{
+public:
+    struct Job
+    {
+        std::string baseFileName;
+        std::vector<Point> points;
+        PointFile::Info info;
+    };
+
+    typedef std::function<void(const Job& job)> SinkFunction;
+
+    // With 0 writer threads, Submit() writes everything before it returns
+    OutputPipeline(int writerThreadCount = 2, int maxQueuedJobs = 2)
+        : m_maxQueuedJobs(std::max(maxQueuedJobs, 1))
+    {
+        for (int i = 0; i < writerThreadCount; ++i)
+            m_writers.emplace_back([this]() { WriterThread(); });
+    }
+
+    ~OutputPipeline()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& writer : m_writers)
+            writer.join();
+    }
+
+    void AddSink(const char* name, const SinkFunction& write, bool enabled = true)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sinks.push_back({ name, write, enabled });
+    }
+
+    // Returns false if there is no sink with that name
+    bool EnableSink(const char* name, bool enabled)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Sink& sink : m_sinks)
+        {
+            if (sink.name == name)
+            {
+                sink.enabled = enabled;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Submit(const char* baseFileName, std::vector<Point> points, const PointFile::Info& info = PointFile::Info())
+    {
+        std::shared_ptr<QueuedJob> job = std::make_shared<QueuedJob>();
+        job->job.baseFileName = baseFileName;
+        job->job.points = std::move(points);
+        job->job.info = info;
+
+        // with no writer threads, write it now
+        if (m_writers.empty())
+        {
+            for (const Sink& sink : m_sinks)
+            {
+                if (sink.enabled)
+                    sink.write(job->job);
+            }
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobDone.wait(lock, [this]() { return m_jobsInFlight < m_maxQueuedJobs; });
+
+        for (const Sink& sink : m_sinks)
+        {
+            if (sink.enabled)
+            {
+                m_workItems.push_back({ job, sink.write });
+                job->sinksLeft++;
+            }
+        }
+        if (job->sinksLeft == 0)
+            return;
+
+        m_jobsInFlight++;
+        lock.unlock();
+        m_wake.notify_all();
+    }
+
+    // Waits until everything submitted so far has been written
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobDone.wait(lock, [this]() { return m_jobsInFlight == 0; });
+    }
+
+private:
+    struct Sink
+    {
+        std::string name;
+        SinkFunction write;
+        bool enabled;
+    };
+
+    struct QueuedJob
+    {
+        Job job;
+        int sinksLeft = 0;
+    };
+
+    struct WorkItem
+    {
+        std::shared_ptr<QueuedJob> job;
+        SinkFunction write;
+    };
+
+    void WriterThread()
+    {
+        while (true)
+        {
+            WorkItem workItem;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_quit || !m_workItems.empty(); });
+                if (m_workItems.empty())
+                    return;
+                workItem = std::move(m_workItems.front());
+                m_workItems.pop_front();
+            }
+
+            workItem.write(workItem.job->job);
+
+            bool jobDone = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--workItem.job->sinksLeft == 0)
+                {
+                    m_jobsInFlight--;
+                    jobDone = true;
+                }
+            }
+            if (jobDone)
+                m_jobDone.notify_all();
+        }
+    }
+
+    std::vector<Sink> m_sinks;
+    std::vector<std::thread> m_writers;
+    std::deque<WorkItem> m_workItems;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_jobDone;
+    int m_maxQueuedJobs = 2;
+    int m_jobsInFlight = 0;
+    bool m_quit = false;
+};
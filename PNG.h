@@ -0,0 +1,836 @@
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "stb/stb_image_write.h"
+#include "ThreadPool.h"
+
+// A PNG writer for the bulk image output, which is faster than stbi_write_png and can write 1 bit images.
+//
+// The image is split into strips of rows, which are filtered and compressed in parallel. Each strip is a deflate
+// block that ends on a byte boundary, in its own IDAT chunk, so the strips are just written one after another.
+// The adler32 of the whole image is put together from the strips' adler32s, and goes in a last, small IDAT chunk.
+//
+// Fast compression is LZ77 with one hash table probe per position, and a dynamic Huffman code per strip.
+// Stored compression doesn't compress at all, for images that are read back soon, or where size doesn't matter.
+// STB compression is stbi_write_png, as before. The stb implementation is compiled in main.cpp.
+
+namespace PNG
+{
+    enum class Compression
+    {
+        STB,
+        Stored,
+        Fast,
+    };
+
+    // Strips are about this many bytes of filtered rows
+    static const int c_stripSize = 1 << 16;
+
+    static const int c_hashBits = 15;
+    static const int c_windowSize = 32768;
+    static const int c_minMatch = 4;
+    static const int c_maxMatch = 258;
+
+    // Slicing by 8: tables[k][i] is the crc of byte i followed by k zero bytes, so 8 bytes can be done at once
+    inline uint32_t CRC32(uint32_t crc, const unsigned char* data, size_t size)
+    {
+        static const std::vector<uint32_t> c_tables = []()
+        {
+            std::vector<uint32_t> tables(256 * 8);
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : (c >> 1);
+                tables[i] = c;
+            }
+            for (int k = 1; k < 8; ++k)
+            {
+                for (int i = 0; i < 256; ++i)
+                    tables[k * 256 + i] = tables[tables[(k - 1) * 256 + i] & 0xFF] ^ (tables[(k - 1) * 256 + i] >> 8);
+            }
+            return tables;
+        }();
+        const uint32_t* t = c_tables.data();
+
+        crc = ~crc;
+        for (; size >= 8; size -= 8, data += 8)
+        {
+            uint32_t low, high;
+            memcpy(&low, data, 4);
+            memcpy(&high, data + 4, 4);
+            low ^= crc;
+            crc = t[7 * 256 + (low & 0xFF)] ^ t[6 * 256 + ((low >> 8) & 0xFF)] ^ t[5 * 256 + ((low >> 16) & 0xFF)] ^ t[4 * 256 + (low >> 24)] ^
+                t[3 * 256 + (high & 0xFF)] ^ t[2 * 256 + ((high >> 8) & 0xFF)] ^ t[256 + ((high >> 16) & 0xFF)] ^ t[high >> 24];
+        }
+        for (; size > 0; --size)
+            crc = t[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static const uint32_t c_adlerBase = 65521;
+
+    inline uint32_t Adler32(uint32_t adler, const unsigned char* data, size_t size)
+    {
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (size > 0)
+        {
+            // the most bytes before b can overflow
+            size_t blockSize = std::min(size, size_t(5552));
+            for (size_t i = 0; i < blockSize; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= c_adlerBase;
+            b %= c_adlerBase;
+            data += blockSize;
+            size -= blockSize;
+        }
+        return a | (b << 16);
+    }
+
+    // The adler32 of two pieces of data put together, from their adler32s and the size of the second
+    inline uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2)
+    {
+        uint32_t remainder = uint32_t(size2 % c_adlerBase);
+        uint32_t a = adler1 & 0xFFFF;
+        uint32_t b = uint32_t((uint64_t(remainder) * a) % c_adlerBase);
+        a += (adler2 & 0xFFFF) + c_adlerBase - 1;
+        b += (adler1 >> 16) + (adler2 >> 16) + c_adlerBase - remainder;
+        if (a >= c_adlerBase)
+            a -= c_adlerBase;
+        if (a >= c_adlerBase)
+            a -= c_adlerBase;
+        if (b >= c_adlerBase * 2)
+            b -= c_adlerBase * 2;
+        if (b >= c_adlerBase)
+            b -= c_adlerBase;
+        return a | (b << 16);
+    }
+
+    // Writes bits least significant first, the way deflate wants them
+    class BitWriter
+    {
+    public:
+        BitWriter(std::vector<unsigned char>& out)
+            : m_out(out)
+        {
+        }
+
+        // count can be up to 32
+        void Write(uint32_t value, int count)
+        {
+            m_bits |= uint64_t(value) << m_count;
+            m_count += count;
+            if (m_count >= 32)
+            {
+                unsigned char bytes[4] = { (unsigned char)m_bits, (unsigned char)(m_bits >> 8), (unsigned char)(m_bits >> 16), (unsigned char)(m_bits >> 24) };
+                m_out.insert(m_out.end(), bytes, bytes + 4);
+                m_bits >>= 32;
+                m_count -= 32;
+            }
+        }
+
+        // Pads with zeros to a byte boundary, and writes out everything
+        void Flush()
+        {
+            while (m_count > 0)
+            {
+                m_out.push_back((unsigned char)m_bits);
+                m_bits >>= 8;
+                m_count = std::max(m_count - 8, 0);
+            }
+            m_bits = 0;
+        }
+
+    private:
+        std::vector<unsigned char>& m_out;
+        uint64_t m_bits = 0;
+        int m_count = 0;
+    };
+
+    // Huffman code lengths for the symbol frequencies, none longer than maxLength.
+    // If the code is too long, the frequencies are flattened and it's made again.
+    inline void MakeCodeLengths(const uint32_t* frequencies, int symbolCount, int maxLength, unsigned char* lengths)
+    {
+        std::vector<uint32_t> freqs(frequencies, frequencies + symbolCount);
+
+        // decoders want at least two codes
+        int usedCount = 0;
+        for (uint32_t f : freqs)
+            usedCount += (f > 0) ? 1 : 0;
+        for (int i = 0; i < symbolCount && usedCount < 2; ++i)
+        {
+            if (freqs[i] == 0)
+            {
+                freqs[i] = 1;
+                usedCount++;
+            }
+        }
+
+        std::vector<int> symbols;
+        std::vector<uint32_t> nodeFreqs;
+        std::vector<int> parents;
+        std::vector<int> depths;
+        while (true)
+        {
+            symbols.clear();
+            for (int i = 0; i < symbolCount; ++i)
+            {
+                if (freqs[i] > 0)
+                    symbols.push_back(i);
+            }
+            std::stable_sort(symbols.begin(), symbols.end(), [&](int a, int b) { return freqs[a] < freqs[b]; });
+
+            // Leaves are nodes [0, leafCount) in increasing frequency, and the nodes made by joining two are added
+            // after them, which are also in increasing frequency, so the two smallest are always at the front of one
+            // of the two lists.
+            int leafCount = int(symbols.size());
+            int nodeCount = leafCount * 2 - 1;
+            nodeFreqs.resize(nodeCount);
+            parents.assign(nodeCount, -1);
+            for (int i = 0; i < leafCount; ++i)
+                nodeFreqs[i] = freqs[symbols[i]];
+
+            int nextLeaf = 0;
+            int nextJoined = leafCount;
+            for (int node = leafCount; node < nodeCount; ++node)
+            {
+                int children[2];
+                for (int& child : children)
+                {
+                    if (nextLeaf < leafCount && (nextJoined >= node || nodeFreqs[nextLeaf] <= nodeFreqs[nextJoined]))
+                        child = nextLeaf++;
+                    else
+                        child = nextJoined++;
+                }
+                nodeFreqs[node] = nodeFreqs[children[0]] + nodeFreqs[children[1]];
+                parents[children[0]] = node;
+                parents[children[1]] = node;
+            }
+
+            // parents come after their children, so depths can be found from the root down
+            depths.assign(nodeCount, 0);
+            int longest = 0;
+            for (int node = nodeCount - 2; node >= 0; --node)
+            {
+                depths[node] = depths[parents[node]] + 1;
+                longest = std::max(longest, depths[node]);
+            }
+
+            if (longest <= maxLength)
+            {
+                memset(lengths, 0, symbolCount);
+                for (int i = 0; i < leafCount; ++i)
+                    lengths[symbols[i]] = (unsigned char)depths[i];
+                return;
+            }
+
+            for (uint32_t& f : freqs)
+            {
+                if (f > 0)
+                    f = (f >> 1) | 1;
+            }
+        }
+    }
+
+    // Canonical Huffman codes for the code lengths, bit reversed so they can be written least significant bit first
+    inline void MakeCodes(const unsigned char* lengths, int symbolCount, uint16_t* codes)
+    {
+        int lengthCounts[16] = {};
+        for (int i = 0; i < symbolCount; ++i)
+            lengthCounts[lengths[i]]++;
+        lengthCounts[0] = 0;
+
+        int nextCode[16] = {};
+        int code = 0;
+        for (int length = 1; length < 16; ++length)
+        {
+            code = (code + lengthCounts[length - 1]) << 1;
+            nextCode[length] = code;
+        }
+
+        for (int i = 0; i < symbolCount; ++i)
+        {
+            int length = lengths[i];
+            if (length == 0)
+            {
+                codes[i] = 0;
+                continue;
+            }
+            int value = nextCode[length]++;
+            int reversed = 0;
+            for (int bit = 0; bit < length; ++bit)
+                reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+            codes[i] = uint16_t(reversed);
+        }
+    }
+
+    // Deflate's match lengths and distances are a code, then extra bits that are added to the code's base
+    static const int c_lengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int c_lengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int c_distanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int c_distanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    // Lookup tables from match lengths and distances to their codes
+    struct CodeTables
+    {
+        unsigned char lengthCodes[259];
+        unsigned char distanceCodes[512];
+
+        CodeTables()
+        {
+            for (int code = 0; code < 29; ++code)
+            {
+                for (int i = 0; i < (1 << c_lengthExtraBits[code]) && c_lengthBases[code] + i <= 258; ++i)
+                    lengthCodes[c_lengthBases[code] + i] = (unsigned char)code;
+            }
+
+            // Distances over 256 have at least 7 extra bits, so they can be looked up by distance >> 7
+            for (int code = 0; code < 30; ++code)
+            {
+                for (int i = 0; i < (1 << c_distanceExtraBits[code]); ++i)
+                {
+                    int d = c_distanceBases[code] - 1 + i;
+                    distanceCodes[(d < 256) ? d : 256 + (d >> 7)] = (unsigned char)code;
+                }
+            }
+        }
+
+        int LengthCode(int length) const
+        {
+            return lengthCodes[length];
+        }
+
+        int DistanceCode(int distance) const
+        {
+            int d = distance - 1;
+            return distanceCodes[(d < 256) ? d : 256 + (d >> 7)];
+        }
+    };
+
+    inline const CodeTables& GetCodeTables()
+    {
+        static const CodeTables tables;
+        return tables;
+    }
+
+    inline uint32_t Load32(const unsigned char* p)
+    {
+        uint32_t ret;
+        memcpy(&ret, p, sizeof(ret));
+        return ret;
+    }
+
+    inline uint64_t Load64(const unsigned char* p)
+    {
+        uint64_t ret;
+        memcpy(&ret, p, sizeof(ret));
+        return ret;
+    }
+
+    // Writes the data as stored deflate blocks, which end on a byte boundary
+    inline void DeflateStored(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out)
+    {
+        do
+        {
+            size_t blockSize = std::min(size, size_t(65535));
+            bool lastBlock = final && blockSize == size;
+            unsigned char header[5] = {
+                (unsigned char)(lastBlock ? 1 : 0),
+                (unsigned char)blockSize, (unsigned char)(blockSize >> 8),
+                (unsigned char)~blockSize, (unsigned char)(~blockSize >> 8)
+            };
+            out.insert(out.end(), header, header + 5);
+            out.insert(out.end(), data, data + blockSize);
+            data += blockSize;
+            size -= blockSize;
+        }
+        while (size > 0);
+    }
+
+    // Writes the data as one dynamic Huffman deflate block, followed by an empty stored block to get to a byte
+    // boundary if it isn't the final block. Falls back to stored blocks if those would be smaller.
+    inline void DeflateFast(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out)
+    {
+        // A symbol is a literal byte, with a distance of 0, or a match length and distance
+        struct Symbol
+        {
+            uint16_t value;
+            uint16_t distance;
+        };
+        std::vector<Symbol> symbols;
+        symbols.reserve(size / 2);
+
+        uint32_t litLenFreqs[286] = {};
+        uint32_t distanceFreqs[30] = {};
+        const CodeTables& tables = GetCodeTables();
+
+        std::vector<int32_t> table(1 << c_hashBits, -1);
+        size_t pos = 0;
+        while (pos + c_minMatch <= size)
+        {
+            uint32_t bytes = Load32(&data[pos]);
+            uint32_t hash = (bytes * 2654435761u) >> (32 - c_hashBits);
+            int32_t candidate = table[hash];
+            table[hash] = int32_t(pos);
+
+            if (candidate >= 0 && pos - candidate <= c_windowSize && Load32(&data[candidate]) == bytes)
+            {
+                int maxLength = int(std::min(size - pos, size_t(c_maxMatch)));
+                int length = c_minMatch;
+                while (length + 8 <= maxLength && Load64(&data[candidate + length]) == Load64(&data[pos + length]))
+                    length += 8;
+                while (length < maxLength && data[candidate + length] == data[pos + length])
+                    length++;
+
+                int distance = int(pos - candidate);
+                symbols.push_back({ uint16_t(length), uint16_t(distance) });
+                litLenFreqs[257 + tables.LengthCode(length)]++;
+                distanceFreqs[tables.DistanceCode(distance)]++;
+                pos += length;
+            }
+            else
+            {
+                symbols.push_back({ data[pos], 0 });
+                litLenFreqs[data[pos]]++;
+                pos++;
+            }
+        }
+        for (; pos < size; ++pos)
+        {
+            symbols.push_back({ data[pos], 0 });
+            litLenFreqs[data[pos]]++;
+        }
+        litLenFreqs[256] = 1;
+
+        unsigned char litLenLengths[286];
+        unsigned char distanceLengths[30];
+        MakeCodeLengths(litLenFreqs, 286, 15, litLenLengths);
+        MakeCodeLengths(distanceFreqs, 30, 15, distanceLengths);
+
+        int litLenCount = 286;
+        while (litLenCount > 257 && litLenLengths[litLenCount - 1] == 0)
+            litLenCount--;
+        int distanceCount = 30;
+        while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+            distanceCount--;
+
+        // The code lengths are sent run length encoded: 16 repeats the last length 3-6 times, 17 is 3-10 zeros,
+        // and 18 is 11-138 zeros. Each run is (symbol << 8) | extra bits.
+        unsigned char allLengths[286 + 30];
+        memcpy(allLengths, litLenLengths, litLenCount);
+        memcpy(allLengths + litLenCount, distanceLengths, distanceCount);
+        int allLengthsCount = litLenCount + distanceCount;
+
+        std::vector<uint16_t> runs;
+        uint32_t codeLengthFreqs[19] = {};
+        for (int i = 0; i < allLengthsCount;)
+        {
+            int length = allLengths[i];
+            int runLength = 1;
+            while (i + runLength < allLengthsCount && allLengths[i + runLength] == length)
+                runLength++;
+            i += runLength;
+
+            if (length == 0)
+            {
+                while (runLength >= 11)
+                {
+                    int count = std::min(runLength, 138);
+                    runs.push_back(uint16_t((18 << 8) | (count - 11)));
+                    runLength -= count;
+                }
+                if (runLength >= 3)
+                {
+                    runs.push_back(uint16_t((17 << 8) | (runLength - 3)));
+                    runLength = 0;
+                }
+            }
+            else
+            {
+                runs.push_back(uint16_t(length << 8));
+                runLength--;
+                while (runLength >= 3)
+                {
+                    int count = std::min(runLength, 6);
+                    runs.push_back(uint16_t((16 << 8) | (count - 3)));
+                    runLength -= count;
+                }
+            }
+            for (; runLength > 0; --runLength)
+                runs.push_back(uint16_t(length << 8));
+        }
+        for (uint16_t run : runs)
+            codeLengthFreqs[run >> 8]++;
+
+        static const int c_codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        static const int c_runExtraBits[3] = { 2, 3, 7 };
+        unsigned char codeLengthLengths[19];
+        MakeCodeLengths(codeLengthFreqs, 19, 7, codeLengthLengths);
+        int codeLengthCount = 19;
+        while (codeLengthCount > 4 && codeLengthLengths[c_codeLengthOrder[codeLengthCount - 1]] == 0)
+            codeLengthCount--;
+
+        // how many bits the block would be, to compare to storing it
+        uint64_t bitCount = 3 + 5 + 5 + 4 + 3 * codeLengthCount;
+        for (uint16_t run : runs)
+            bitCount += codeLengthLengths[run >> 8] + ((run >> 8) >= 16 ? c_runExtraBits[(run >> 8) - 16] : 0);
+        for (int i = 0; i < 286; ++i)
+            bitCount += uint64_t(litLenFreqs[i]) * (litLenLengths[i] + ((i > 256) ? c_lengthExtraBits[i - 257] : 0));
+        for (int i = 0; i < 30; ++i)
+            bitCount += uint64_t(distanceFreqs[i]) * (distanceLengths[i] + c_distanceExtraBits[i]);
+        if (bitCount / 8 + 6 >= size + 5 * (size / 65535 + 1))
+        {
+            DeflateStored(data, size, final, out);
+            return;
+        }
+
+        uint16_t litLenCodes[286];
+        uint16_t distanceCodes[30];
+        uint16_t codeLengthCodes[19];
+        MakeCodes(litLenLengths, 286, litLenCodes);
+        MakeCodes(distanceLengths, 30, distanceCodes);
+        MakeCodes(codeLengthLengths, 19, codeLengthCodes);
+
+        BitWriter writer(out);
+        writer.Write(final ? 1 : 0, 1);
+        writer.Write(2, 2);
+        writer.Write(litLenCount - 257, 5);
+        writer.Write(distanceCount - 1, 5);
+        writer.Write(codeLengthCount - 4, 4);
+        for (int i = 0; i < codeLengthCount; ++i)
+            writer.Write(codeLengthLengths[c_codeLengthOrder[i]], 3);
+        for (uint16_t run : runs)
+        {
+            int symbol = run >> 8;
+            writer.Write(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+            if (symbol >= 16)
+                writer.Write(run & 0xFF, c_runExtraBits[symbol - 16]);
+        }
+
+        for (const Symbol& symbol : symbols)
+        {
+            if (symbol.distance == 0)
+            {
+                writer.Write(litLenCodes[symbol.value], litLenLengths[symbol.value]);
+                continue;
+            }
+
+            int lengthCode = tables.LengthCode(symbol.value);
+            writer.Write(litLenCodes[257 + lengthCode], litLenLengths[257 + lengthCode]);
+            writer.Write(symbol.value - c_lengthBases[lengthCode], c_lengthExtraBits[lengthCode]);
+
+            int distanceCode = tables.DistanceCode(symbol.distance);
+            writer.Write(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+            writer.Write(symbol.distance - c_distanceBases[distanceCode], c_distanceExtraBits[distanceCode]);
+        }
+        writer.Write(litLenCodes[256], litLenLengths[256]);
+
+        // an empty stored block gets the next strip to a byte boundary
+        if (!final)
+        {
+            writer.Write(0, 3);
+            writer.Flush();
+            unsigned char empty[4] = { 0, 0, 0xFF, 0xFF };
+            out.insert(out.end(), empty, empty + 4);
+        }
+        else
+            writer.Flush();
+    }
+
+    // Written without branches on the pixel values, so the compiler can vectorize the loops that use it
+    inline int Paeth(int a, int b, int c)
+    {
+        int pa = abs(b - c);
+        int pb = abs(a - c);
+        int pc = abs(a + b - 2 * c);
+        int bc = (pb <= pc) ? b : c;
+        return (pa <= pb && pa <= pc) ? a : bc;
+    }
+
+    // Applies a PNG filter to a row. The row before the first row is all zeros.
+    inline void FilterRow(int filter, const unsigned char* row, const unsigned char* previous, int rowBytes, int bytesPerPixel, unsigned char* out)
+    {
+        int bpp = std::min(bytesPerPixel, rowBytes);
+        switch (filter)
+        {
+            case 0:
+            {
+                memcpy(out, row, rowBytes);
+                break;
+            }
+            case 1:
+            {
+                memcpy(out, row, bpp);
+                for (int i = bpp; i < rowBytes; ++i)
+                    out[i] = (unsigned char)(row[i] - row[i - bpp]);
+                break;
+            }
+            case 2:
+            {
+                for (int i = 0; i < rowBytes; ++i)
+                    out[i] = (unsigned char)(row[i] - previous[i]);
+                break;
+            }
+            case 3:
+            {
+                for (int i = 0; i < bpp; ++i)
+                    out[i] = (unsigned char)(row[i] - (previous[i] >> 1));
+                for (int i = bpp; i < rowBytes; ++i)
+                    out[i] = (unsigned char)(row[i] - ((row[i - bpp] + previous[i]) >> 1));
+                break;
+            }
+            case 4:
+            {
+                for (int i = 0; i < bpp; ++i)
+                    out[i] = (unsigned char)(row[i] - previous[i]);
+                for (int i = bpp; i < rowBytes; ++i)
+                    out[i] = (unsigned char)(row[i] - Paeth(row[i - bpp], previous[i], previous[i - bpp]));
+                break;
+            }
+        }
+    }
+
+    // Filters a row with all five filters, into candidates[filter * rowBytes], and returns the filter that stb would
+    // pick: the one with the smallest sum of the absolute values of the filtered bytes, as signed bytes.
+    inline int PickFilter(const unsigned char* row, const unsigned char* previous, int rowBytes, int bytesPerPixel, unsigned char* candidates)
+    {
+        int sums[5] = {};
+#if defined(__AVX2__)
+        // The first pixel has nothing to the left, so FilterRow does it, and the rest is done 16 bytes at a time as
+        // 16 bit values, with the leftover bytes done one at a time.
+        int bpp = std::min(bytesPerPixel, rowBytes);
+        for (int filter = 0; filter < 5; ++filter)
+            FilterRow(filter, row, previous, bpp, bpp, &candidates[filter * rowBytes]);
+
+        int i = bpp;
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&row[i]));
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&row[i - bpp]));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&previous[i]));
+            __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&previous[i - bpp]));
+
+            __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+            __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+            __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(_mm256_sub_epi16(b, c), _mm256_sub_epi16(a, c)));
+            __m256i notA = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb), _mm256_cmpgt_epi16(pa, pc));
+            __m256i bc = _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc));
+            __m256i paeth = _mm256_blendv_epi8(a, bc, notA);
+
+            __m256i predictions[4] = { a, b, _mm256_srli_epi16(_mm256_add_epi16(a, b), 1), paeth };
+            for (int filter = 1; filter < 5; ++filter)
+            {
+                __m256i filtered = _mm256_and_si256(_mm256_sub_epi16(x, predictions[filter - 1]), _mm256_set1_epi16(0xFF));
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(filtered, filtered), 0x08);
+                _mm_storeu_si128((__m128i*)&candidates[filter * rowBytes + i], _mm256_castsi256_si128(packed));
+            }
+        }
+        memcpy(&candidates[bpp], &row[bpp], rowBytes - bpp);
+        for (; i < rowBytes; ++i)
+        {
+            int a = row[i - bpp];
+            int b = previous[i];
+            int c = previous[i - bpp];
+            candidates[rowBytes + i] = (unsigned char)(row[i] - a);
+            candidates[rowBytes * 2 + i] = (unsigned char)(row[i] - b);
+            candidates[rowBytes * 3 + i] = (unsigned char)(row[i] - ((a + b) >> 1));
+            candidates[rowBytes * 4 + i] = (unsigned char)(row[i] - Paeth(a, b, c));
+        }
+
+        for (int filter = 0; filter < 5; ++filter)
+        {
+            const unsigned char* candidate = &candidates[filter * rowBytes];
+            __m256i sum = _mm256_setzero_si256();
+            int j = 0;
+            for (; j + 32 <= rowBytes; j += 32)
+            {
+                __m256i bytes = _mm256_abs_epi8(_mm256_loadu_si256((const __m256i*)&candidate[j]));
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+            }
+            __m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            sums[filter] = int(_mm_cvtsi128_si64(sum128) + _mm_extract_epi64(sum128, 1));
+            for (; j < rowBytes; ++j)
+                sums[filter] += abs((signed char)candidate[j]);
+        }
+#else
+        for (int filter = 0; filter < 5; ++filter)
+        {
+            unsigned char* candidate = &candidates[filter * rowBytes];
+            FilterRow(filter, row, previous, rowBytes, bytesPerPixel, candidate);
+            for (int i = 0; i < rowBytes; ++i)
+                sums[filter] += abs((signed char)candidate[i]);
+        }
+#endif
+        return int(std::min_element(sums, sums + 5) - sums);
+    }
+
+    // Writes a PNG of rows of rowBytes bytes. pickFilters picks the filter of each row the way stb does, with the
+    // smallest sum of the absolute values of the filtered bytes. Otherwise rows aren't filtered.
+    inline bool WriteRows(const char* fileName, int width, int height, int bitDepth, int colorType, int bytesPerPixel, int rowBytes,
+        const unsigned char* pixels, Compression compression, bool pickFilters)
+    {
+        int rowsPerStrip = std::max(c_stripSize / (rowBytes + 1), 1);
+        int stripCount = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+        struct Strip
+        {
+            std::vector<unsigned char> chunk;
+            uint32_t adler = 1;
+            size_t size = 0;
+        };
+        std::vector<Strip> strips(stripCount);
+
+        GetThreadPool().ParallelFor(stripCount,
+            [&](int index, int threadIndex)
+            {
+                int beginRow = index * rowsPerStrip;
+                int endRow = std::min(beginRow + rowsPerStrip, height);
+
+                Strip& strip = strips[index];
+                std::vector<unsigned char> filtered(size_t(endRow - beginRow) * (rowBytes + 1));
+                std::vector<unsigned char> candidates(pickFilters ? rowBytes * 5 : 0);
+                std::vector<unsigned char> zeros(rowBytes, 0);
+                unsigned char* out = filtered.data();
+                for (int y = beginRow; y < endRow; ++y, out += rowBytes + 1)
+                {
+                    const unsigned char* row = &pixels[size_t(y) * rowBytes];
+                    const unsigned char* previous = (y > 0) ? row - rowBytes : zeros.data();
+
+                    if (pickFilters)
+                    {
+                        int filter = PickFilter(row, previous, rowBytes, bytesPerPixel, candidates.data());
+                        out[0] = (unsigned char)filter;
+                        memcpy(out + 1, &candidates[filter * rowBytes], rowBytes);
+                    }
+                    else
+                    {
+                        out[0] = 0;
+                        memcpy(out + 1, row, rowBytes);
+                    }
+                }
+                strip.adler = Adler32(1, filtered.data(), filtered.size());
+                strip.size = filtered.size();
+
+                // the chunk is its length, "IDAT", the data, and the crc, with the zlib header at the start of the first
+                strip.chunk.reserve(filtered.size() / ((compression == Compression::Fast) ? 4 : 1) + 64);
+                strip.chunk.resize(8);
+                memcpy(&strip.chunk[4], "IDAT", 4);
+                if (index == 0)
+                {
+                    strip.chunk.push_back(0x78);
+                    strip.chunk.push_back(0x01);
+                }
+                bool final = (index == stripCount - 1);
+                if (compression == Compression::Fast)
+                    DeflateFast(filtered.data(), filtered.size(), final, strip.chunk);
+                else
+                    DeflateStored(filtered.data(), filtered.size(), final, strip.chunk);
+
+                uint32_t length = uint32_t(strip.chunk.size() - 8);
+                unsigned char lengthBytes[4] = { (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length };
+                memcpy(strip.chunk.data(), lengthBytes, 4);
+                uint32_t crc = CRC32(0, &strip.chunk[4], strip.chunk.size() - 4);
+                unsigned char crcBytes[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+                strip.chunk.insert(strip.chunk.end(), crcBytes, crcBytes + 4);
+            }
+        );
+
+        uint32_t adler = 1;
+        for (const Strip& strip : strips)
+            adler = Adler32Combine(adler, strip.adler, strip.size);
+
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "wb");
+        if (!file)
+        {
+            printf("PNG::Write(): could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        auto WriteChunk = [file](const char* type, const unsigned char* data, uint32_t size)
+        {
+            unsigned char chunk[4 + 4 + 13];
+            chunk[0] = (unsigned char)(size >> 24);
+            chunk[1] = (unsigned char)(size >> 16);
+            chunk[2] = (unsigned char)(size >> 8);
+            chunk[3] = (unsigned char)size;
+            memcpy(&chunk[4], type, 4);
+            if (size > 0)
+                memcpy(&chunk[8], data, size);
+            uint32_t crc = CRC32(0, &chunk[4], size + 4);
+            unsigned char crcBytes[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+            fwrite(chunk, 1, size + 8, file);
+            fwrite(crcBytes, 1, 4, file);
+        };
+
+        static const unsigned char c_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        fwrite(c_signature, 1, 8, file);
+
+        unsigned char header[13] = {
+            (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+            (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+            (unsigned char)bitDepth, (unsigned char)colorType, 0, 0, 0
+        };
+        WriteChunk("IHDR", header, 13);
+
+        for (const Strip& strip : strips)
+            fwrite(strip.chunk.data(), 1, strip.chunk.size(), file);
+
+        unsigned char adlerBytes[4] = { (unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler };
+        WriteChunk("IDAT", adlerBytes, 4);
+        WriteChunk("IEND", nullptr, 0);
+
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    // Writes an 8 bit image with 1 to 4 channels: grey, grey alpha, RGB or RGBA
+    inline bool Write(const char* fileName, int width, int height, int channels, const unsigned char* pixels, Compression compression)
+    {
+        if (compression == Compression::STB)
+            return stbi_write_png(fileName, width, height, channels, pixels, 0) != 0;
+
+        static const int c_colorTypes[5] = { 0, 0, 4, 2, 6 };
+        return WriteRows(fileName, width, height, 8, c_colorTypes[channels], channels, width * channels, pixels, compression,
+            compression == Compression::Fast);
+    }
+
+    // Writes an 8 bit grey image that is only black and white as a 1 bit image. Pixels of 128 and up are white.
+    // STB compression writes it as 8 bit.
+    inline bool WriteBW(const char* fileName, int width, int height, const unsigned char* pixels, Compression compression)
+    {
+        if (compression == Compression::STB)
+            return stbi_write_png(fileName, width, height, 1, pixels, 0) != 0;
+
+        int rowBytes = (width + 7) / 8;
+        std::vector<unsigned char> packed(size_t(rowBytes) * height, 0);
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* row = &pixels[size_t(y) * width];
+            unsigned char* out = &packed[size_t(y) * rowBytes];
+            for (int x = 0; x < width; ++x)
+            {
+                if (row[x] >= 128)
+                    out[x / 8] |= (unsigned char)(0x80 >> (x % 8));
+            }
+        }
+
+        // filters don't help images of less than 8 bits a pixel much
+        return WriteRows(fileName, width, height, 1, 0, 1, rowBytes, packed.data(), compression, false);
+    }
+};
@@ -0,0 +1,533 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "DFT.h"
+#include "IndexToColor.h"
+#include "ThreadPool.h"
+
+// Periodograms of multi class point sets, straight from the points, for each subset of the classes.
+//
+// The periodogram of n points is P(k) = |sum over points of exp(-2 pi i k.x)|^2 / n, on the integer frequencies k.
+// White noise is 1 everywhere, and blue noise is near 0 at low frequencies. Unlike the DFT of a rasterized image, there
+// is no aliasing, and no pixel grid in the spectrum.
+//
+// exp(-2 pi i k.x) is exp(-2 pi i kx x) * exp(-2 pi i ky y), and each of those is a power of exp(-2 pi i x), so they are
+// made for every frequency with one sincos per point and axis, and a complex multiply per frequency after that. The
+// sum over the points is then a complex matrix multiply of the x terms and the y terms, which is done on the thread
+// pool in chunks of points, 8 frequencies at a time with SIMD.
+//
+// The sums are linear, so they are made once per class, and a subset's sum is the sum of its classes' sums. Point sets
+// are real, so P(-k) = P(k), and only half of the frequencies are summed.
+//
+// The spectra of many point sets are averaged with a running mean, and summarized per ring of frequencies as radially
+// averaged power, and as anisotropy, which is how far the power in a ring is from being the same in every direction.
+
+namespace Periodogram
+{
+    // Frequencies [-size/2, size/2) on each axis, row major, with frequency 0 at (size/2, size/2). Frequency 0 is n,
+    // which is much more than anything else, so it's set to 0, like MultiDFT.py does.
+    struct Spectrum
+    {
+        int size = 0;
+        std::vector<float> power;
+    };
+
+    static const int c_pointsPerChunk = 512;
+    static const int c_pointsPerBlock = 32;
+
+    // The sums of exp(-2 pi i k.x) over some points, for ky in [0, size/2] and kx in [-size/2, size/2], padded to a
+    // multiple of 8 columns
+    struct Sums
+    {
+        int size = 0;
+        int rows = 0;
+        int columns = 0;
+        std::vector<float> real;
+        std::vector<float> imaginary;
+    };
+
+    // exp(-2 pi i k v) for count frequencies, starting at k = firstK
+    inline void MakeTerms(float v, int firstK, int count, float* real, float* imaginary)
+    {
+        // in double, so the error of the recurrence doesn't build up. Every 4th frequency is its own recurrence, so
+        // the 4 of them don't wait on each other.
+        static const double c_twoPi = 6.28318530717958647692;
+        double stepRe = cos(c_twoPi * v * 4.0);
+        double stepIm = -sin(c_twoPi * v * 4.0);
+        double re[4];
+        double im[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            re[j] = cos(c_twoPi * v * double(firstK + j));
+            im[j] = -sin(c_twoPi * v * double(firstK + j));
+        }
+
+        for (int i = 0; i < count; i += 4)
+        {
+            for (int j = 0; j < 4 && i + j < count; ++j)
+            {
+                real[i + j] = float(re[j]);
+                imaginary[i + j] = float(im[j]);
+            }
+            for (int j = 0; j < 4; ++j)
+            {
+                double nextRe = re[j] * stepRe - im[j] * stepIm;
+                im[j] = re[j] * stepIm + im[j] * stepRe;
+                re[j] = nextRe;
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    // Adds y times the 8 x terms at termXRe/termXIm to re/im
+    inline void AddProduct(__m256 termYRe, __m256 termYIm, const float* termXRe, const float* termXIm, __m256& re, __m256& im)
+    {
+        __m256 xRe = _mm256_loadu_ps(termXRe);
+        __m256 xIm = _mm256_loadu_ps(termXIm);
+        re = _mm256_add_ps(re, _mm256_sub_ps(_mm256_mul_ps(termYRe, xRe), _mm256_mul_ps(termYIm, xIm)));
+        im = _mm256_add_ps(im, _mm256_add_ps(_mm256_mul_ps(termYRe, xIm), _mm256_mul_ps(termYIm, xRe)));
+    }
+#endif
+
+    // The sums for each class
+    inline std::vector<Sums> MakeClassSums(const std::vector<Point>& points, int classCount, int size)
+    {
+        int halfSize = size / 2;
+        int rows = halfSize + 1;
+        int columns = (size + 1 + 7) & ~7;
+
+        std::vector<std::vector<int>> classPoints(classCount);
+        for (int i = 0; i < (int)points.size(); ++i)
+        {
+            if (points[i].classIndex >= 0 && points[i].classIndex < classCount)
+                classPoints[points[i].classIndex].push_back(i);
+        }
+
+        // the points in class order
+        std::vector<int> order;
+        std::vector<int> classStarts(classCount + 1, 0);
+        for (int classIndex = 0; classIndex < classCount; ++classIndex)
+        {
+            order.insert(order.end(), classPoints[classIndex].begin(), classPoints[classIndex].end());
+            classStarts[classIndex + 1] = (int)order.size();
+        }
+
+        // each work item is a chunk of the points of one class, summed over all of the frequencies into its own sums
+        struct Chunk
+        {
+            int classIndex;
+            int pointBegin;
+            int pointEnd;
+            Sums sums;
+        };
+        std::vector<Chunk> chunks;
+        for (int classIndex = 0; classIndex < classCount; ++classIndex)
+        {
+            for (int pointBegin = classStarts[classIndex]; pointBegin < classStarts[classIndex + 1]; pointBegin += c_pointsPerChunk)
+                chunks.push_back({ classIndex, pointBegin, std::min(pointBegin + c_pointsPerChunk, classStarts[classIndex + 1]), Sums() });
+        }
+
+        ThreadPool& threadPool = GetThreadPool();
+        threadPool.ParallelFor((int)chunks.size(),
+            [&](int index, int threadIndex)
+            {
+                Chunk& chunk = chunks[index];
+                chunk.sums.real.assign(rows * columns, 0.0f);
+                chunk.sums.imaginary.assign(rows * columns, 0.0f);
+
+                // c_pointsPerBlock points at a time, so their terms stay in the cache for all the rows. Every row is
+                // done before moving on, since reading the x terms again is what the time goes to otherwise.
+                std::vector<float> xRe(c_pointsPerBlock * columns), xIm(c_pointsPerBlock * columns);
+                std::vector<float> yRe(c_pointsPerBlock * rows), yIm(c_pointsPerBlock * rows);
+                for (int blockBegin = chunk.pointBegin; blockBegin < chunk.pointEnd; blockBegin += c_pointsPerBlock)
+                {
+                    int blockCount = std::min(c_pointsPerBlock, chunk.pointEnd - blockBegin);
+                    for (int p = 0; p < blockCount; ++p)
+                    {
+                        const Point& point = points[order[blockBegin + p]];
+                        MakeTerms(point.v[0], -halfSize, columns, &xRe[p * columns], &xIm[p * columns]);
+                        MakeTerms(point.v[1], 0, rows, &yRe[p * rows], &yIm[p * rows]);
+                    }
+
+                    for (int row = 0; row < rows; ++row)
+                    {
+                        float* sumRe = &chunk.sums.real[row * columns];
+                        float* sumIm = &chunk.sums.imaginary[row * columns];
+                        int p = 0;
+#if defined(__AVX2__)
+                        // 4 points per pass over the row, so the sums are loaded and stored once per 4 points
+                        for (; p + 4 <= blockCount; p += 4)
+                        {
+                            __m256 termYRe0 = _mm256_set1_ps(yRe[(p + 0) * rows + row]);
+                            __m256 termYIm0 = _mm256_set1_ps(yIm[(p + 0) * rows + row]);
+                            __m256 termYRe1 = _mm256_set1_ps(yRe[(p + 1) * rows + row]);
+                            __m256 termYIm1 = _mm256_set1_ps(yIm[(p + 1) * rows + row]);
+                            __m256 termYRe2 = _mm256_set1_ps(yRe[(p + 2) * rows + row]);
+                            __m256 termYIm2 = _mm256_set1_ps(yIm[(p + 2) * rows + row]);
+                            __m256 termYRe3 = _mm256_set1_ps(yRe[(p + 3) * rows + row]);
+                            __m256 termYIm3 = _mm256_set1_ps(yIm[(p + 3) * rows + row]);
+                            const float* termXRe = &xRe[p * columns];
+                            const float* termXIm = &xIm[p * columns];
+                            for (int column = 0; column < columns; column += 8)
+                            {
+                                __m256 re = _mm256_loadu_ps(&sumRe[column]);
+                                __m256 im = _mm256_loadu_ps(&sumIm[column]);
+                                AddProduct(termYRe0, termYIm0, &termXRe[column], &termXIm[column], re, im);
+                                AddProduct(termYRe1, termYIm1, &termXRe[columns + column], &termXIm[columns + column], re, im);
+                                AddProduct(termYRe2, termYIm2, &termXRe[columns * 2 + column], &termXIm[columns * 2 + column], re, im);
+                                AddProduct(termYRe3, termYIm3, &termXRe[columns * 3 + column], &termXIm[columns * 3 + column], re, im);
+                                _mm256_storeu_ps(&sumRe[column], re);
+                                _mm256_storeu_ps(&sumIm[column], im);
+                            }
+                        }
+#endif
+                        for (; p < blockCount; ++p)
+                        {
+                            float termYRe = yRe[p * rows + row];
+                            float termYIm = yIm[p * rows + row];
+                            const float* termXRe = &xRe[p * columns];
+                            const float* termXIm = &xIm[p * columns];
+                            for (int column = 0; column < columns; ++column)
+                            {
+                                sumRe[column] += termYRe * termXRe[column] - termYIm * termXIm[column];
+                                sumIm[column] += termYRe * termXIm[column] + termYIm * termXRe[column];
+                            }
+                        }
+                    }
+                }
+            }
+        );
+
+        // the sums of a class are the sums of its chunks
+        std::vector<Sums> ret(classCount);
+        threadPool.ParallelFor(classCount,
+            [&](int classIndex, int threadIndex)
+            {
+                Sums& sums = ret[classIndex];
+                sums.size = size;
+                sums.rows = rows;
+                sums.columns = columns;
+                sums.real.assign(rows * columns, 0.0f);
+                sums.imaginary.assign(rows * columns, 0.0f);
+                for (const Chunk& chunk : chunks)
+                {
+                    if (chunk.classIndex != classIndex)
+                        continue;
+                    for (int i = 0; i < rows * columns; ++i)
+                    {
+                        sums.real[i] += chunk.sums.real[i];
+                        sums.imaginary[i] += chunk.sums.imaginary[i];
+                    }
+                }
+            }
+        );
+
+        return ret;
+    }
+
+    // The spectrum of the classes whose bits are set in classMask
+    inline Spectrum MakeSpectrum(const std::vector<Sums>& classSums, const std::vector<int>& classPointCounts, int classMask)
+    {
+        Spectrum ret;
+        if (classSums.empty())
+            return ret;
+
+        int size = classSums[0].size;
+        int halfSize = size / 2;
+        int columns = classSums[0].columns;
+        ret.size = size;
+        ret.power.assign(size * size, 0.0f);
+
+        int pointCount = 0;
+        for (int classIndex = 0; classIndex < (int)classSums.size(); ++classIndex)
+        {
+            if (classMask & (1 << classIndex))
+                pointCount += classPointCounts[classIndex];
+        }
+        if (pointCount == 0)
+            return ret;
+
+        // rows with ky >= 0 are summed directly, and the others are the mirror image, since P(-k) = P(k)
+        std::vector<float> half(classSums[0].rows * columns);
+        for (int i = 0; i < (int)half.size(); ++i)
+        {
+            float re = 0.0f;
+            float im = 0.0f;
+            for (int classIndex = 0; classIndex < (int)classSums.size(); ++classIndex)
+            {
+                if (classMask & (1 << classIndex))
+                {
+                    re += classSums[classIndex].real[i];
+                    im += classSums[classIndex].imaginary[i];
+                }
+            }
+            half[i] = (re * re + im * im) / float(pointCount);
+        }
+
+        for (int y = 0; y < size; ++y)
+        {
+            int ky = y - halfSize;
+            for (int x = 0; x < size; ++x)
+            {
+                int kx = x - halfSize;
+                ret.power[y * size + x] = (ky >= 0) ? half[ky * columns + (kx + halfSize)] : half[-ky * columns + (-kx + halfSize)];
+            }
+        }
+        ret.power[halfSize * size + halfSize] = 0.0f;
+
+        return ret;
+    }
+
+    // The spectrum of every subset of classes, in the order of the sample images: subset i has classMask i + 1
+    inline std::vector<Spectrum> MakeSubsetSpectra(const std::vector<Point>& points, int classCount, int size)
+    {
+        std::vector<int> classPointCounts(classCount, 0);
+        for (const Point& p : points)
+        {
+            if (p.classIndex >= 0 && p.classIndex < classCount)
+                classPointCounts[p.classIndex]++;
+        }
+
+        std::vector<Sums> classSums = MakeClassSums(points, classCount, size);
+
+        int subsetCount = (1 << classCount) - 1;
+        std::vector<Spectrum> ret(subsetCount);
+        GetThreadPool().ParallelFor(subsetCount,
+            [&](int index, int threadIndex)
+            {
+                ret[index] = MakeSpectrum(classSums, classPointCounts, index + 1);
+            }
+        );
+        return ret;
+    }
+
+    // The running mean of the subset spectra of many point sets, so a set's spectra can be let go once they are added
+    struct Average
+    {
+        int count = 0;
+        std::vector<Spectrum> spectra;
+
+        void Add(const std::vector<Spectrum>& newSpectra)
+        {
+            count++;
+            if (count == 1)
+            {
+                spectra = newSpectra;
+                return;
+            }
+
+            float weight = 1.0f / float(count);
+            GetThreadPool().ParallelFor((int)spectra.size(),
+                [&](int index, int threadIndex)
+                {
+                    std::vector<float>& mean = spectra[index].power;
+                    const std::vector<float>& power = newSpectra[index].power;
+                    for (size_t i = 0; i < mean.size(); ++i)
+                        mean[i] += (power[i] - mean[i]) * weight;
+                }
+            );
+        }
+    };
+
+    // Which ring a frequency is in: the length of k, rounded. Rings go out to size/2, which is the last one that fits
+    // in the spectrum, and frequencies past that are -1.
+    inline int GetRing(int x, int y, int size)
+    {
+        int halfSize = size / 2;
+        float kx = float(x - halfSize);
+        float ky = float(y - halfSize);
+        int ring = int(sqrtf(kx * kx + ky * ky) + 0.5f);
+        return (ring <= halfSize) ? ring : -1;
+    }
+
+    // The average power in each ring of frequencies
+    inline std::vector<float> RadialAverage(const Spectrum& spectrum)
+    {
+        int halfSize = spectrum.size / 2;
+        std::vector<double> sums(halfSize + 1, 0.0);
+        std::vector<int> counts(halfSize + 1, 0);
+        for (int y = 0; y < spectrum.size; ++y)
+        {
+            for (int x = 0; x < spectrum.size; ++x)
+            {
+                int ring = GetRing(x, y, spectrum.size);
+                if (ring < 0)
+                    continue;
+                sums[ring] += spectrum.power[y * spectrum.size + x];
+                counts[ring]++;
+            }
+        }
+
+        std::vector<float> ret(halfSize + 1, 0.0f);
+        for (int ring = 0; ring <= halfSize; ++ring)
+            ret[ring] = counts[ring] ? float(sums[ring] / double(counts[ring])) : 0.0f;
+        return ret;
+    }
+
+    // The anisotropy of each ring of frequencies in decibels: 10 log10(variance / mean^2) of the power in the ring.
+    // An isotropic spectrum averaged over M point sets is around -10 log10(M), and directional structure shows up above
+    // that. Rings with fewer than 2 frequencies, or no power, are 0.
+    inline std::vector<float> Anisotropy(const Spectrum& spectrum)
+    {
+        std::vector<float> means = RadialAverage(spectrum);
+        int halfSize = spectrum.size / 2;
+        std::vector<double> sums(halfSize + 1, 0.0);
+        std::vector<int> counts(halfSize + 1, 0);
+        for (int y = 0; y < spectrum.size; ++y)
+        {
+            for (int x = 0; x < spectrum.size; ++x)
+            {
+                int ring = GetRing(x, y, spectrum.size);
+                if (ring < 0)
+                    continue;
+                double difference = double(spectrum.power[y * spectrum.size + x]) - double(means[ring]);
+                sums[ring] += difference * difference;
+                counts[ring]++;
+            }
+        }
+
+        std::vector<float> ret(halfSize + 1, 0.0f);
+        for (int ring = 0; ring <= halfSize; ++ring)
+        {
+            if (counts[ring] < 2 || means[ring] <= 0.0f)
+                continue;
+            double variance = sums[ring] / double(counts[ring] - 1);
+            if (variance > 0.0)
+                ret[ring] = float(10.0 * log10(variance / (double(means[ring]) * double(means[ring]))));
+        }
+        return ret;
+    }
+
+    // Writes the spectrum with the viridis color map, from 0 to maxPower
+    inline bool WriteImage(const char* fileName, const Spectrum& spectrum, float maxPower, PNG::Compression compression = PNG::Compression::Fast)
+    {
+        std::vector<unsigned char> pixels(spectrum.power.size() * 3);
+        for (size_t i = 0; i < spectrum.power.size(); ++i)
+        {
+            unsigned char RGB[3];
+            DFT::Viridis(spectrum.power[i] / maxPower, RGB);
+            memcpy(&pixels[i * 3], RGB, 3);
+        }
+        return PNG::Write(fileName, spectrum.size, spectrum.size, 3, pixels.data(), compression);
+    }
+
+    // Writes a width x height line plot of curves over frequency, with a color per curve from IndexToColor(). The
+    // y axis goes from the smallest to the largest value. There are grey lines every 16 frequencies, and at y = 0 and
+    // y = 1 when they are in range, which are no power and white noise for radial power.
+    inline bool WritePlot(const char* fileName, const std::vector<std::vector<float>>& curves, int width, int height,
+        PNG::Compression compression = PNG::Compression::Fast)
+    {
+        size_t pointCount = curves.empty() ? 0 : curves[0].size();
+        if (pointCount < 2)
+        {
+            printf("Periodogram::WritePlot(): not enough values to plot %s\n", fileName);
+            return false;
+        }
+
+        float minValue = curves[0][0];
+        float maxValue = minValue;
+        for (const std::vector<float>& curve : curves)
+        {
+            for (float f : curve)
+            {
+                minValue = std::min(minValue, f);
+                maxValue = std::max(maxValue, f);
+            }
+        }
+        if (maxValue <= minValue)
+            maxValue = minValue + 1.0f;
+
+        std::vector<unsigned char> pixels(width * height * 3, 255);
+        auto ValueToY = [&](float value)
+        {
+            float t = (value - minValue) / (maxValue - minValue);
+            return std::min(std::max(int(float(height - 1) * (1.0f - t) + 0.5f), 0), height - 1);
+        };
+        auto SetPixel = [&](int x, int y, const unsigned char(&RGB)[3])
+        {
+            memcpy(&pixels[(y * width + x) * 3], RGB, 3);
+        };
+
+        static const unsigned char c_grey[3] = { 208, 208, 208 };
+        for (size_t frequency = 0; frequency < pointCount; frequency += 16)
+        {
+            int x = int(float(frequency) * float(width - 1) / float(pointCount - 1) + 0.5f);
+            for (int y = 0; y < height; ++y)
+                SetPixel(x, y, c_grey);
+        }
+        for (float value : { 0.0f, 1.0f })
+        {
+            if (value < minValue || value > maxValue)
+                continue;
+            int y = ValueToY(value);
+            for (int x = 0; x < width; ++x)
+                SetPixel(x, y, c_grey);
+        }
+
+        // each column of pixels is joined to the last one with a vertical line, 2 pixels wide
+        for (int curveIndex = 0; curveIndex < (int)curves.size(); ++curveIndex)
+        {
+            RGB color = IndexToColor(curveIndex, 1.0f, 0.8f);
+            unsigned char curveRGB[3] = { (unsigned char)(color[0] * 255.0f), (unsigned char)(color[1] * 255.0f), (unsigned char)(color[2] * 255.0f) };
+
+            const std::vector<float>& curve = curves[curveIndex];
+            int lastY = -1;
+            for (int x = 0; x < width; ++x)
+            {
+                float position = float(x) * float(pointCount - 1) / float(width - 1);
+                int index = std::min(int(position), int(pointCount) - 2);
+                int y = ValueToY(Lerp(curve[index], curve[index + 1], position - float(index)));
+                if (lastY < 0)
+                    lastY = y;
+
+                for (int lineY = std::min(y, lastY); lineY <= std::max(y, lastY); ++lineY)
+                {
+                    SetPixel(x, lineY, curveRGB);
+                    SetPixel(std::min(x + 1, width - 1), lineY, curveRGB);
+                }
+                lastY = y;
+            }
+        }
+
+        return PNG::Write(fileName, width, height, 3, pixels.data(), compression);
+    }
+
+    // Writes a csv with a frequency column, and a column for each curve, like the radially averaged power of spectra
+    inline bool WriteRadialCSV(const char* fileName, const std::vector<std::vector<float>>& radials, const std::vector<std::string>& names)
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "wb");
+        if (!file)
+        {
+            printf("Periodogram::WriteRadialCSV(): could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        fprintf(file, "\"Frequency\"");
+        for (const std::string& name : names)
+            fprintf(file, ",\"%s\"", name.c_str());
+        fprintf(file, "\n");
+
+        size_t ringCount = radials.empty() ? 0 : radials[0].size();
+        for (size_t ring = 0; ring < ringCount; ++ring)
+        {
+            fprintf(file, "\"%i\"", int(ring));
+            for (const std::vector<float>& radial : radials)
+                fprintf(file, ",\"%f\"", radial[ring]);
+            fprintf(file, "\n");
+        }
+
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// A versioned binary point set format, which can be memory mapped and used in place.
+//
+// The file is a Header, followed by sections that each start on a 64 byte boundary:
+//   class counts  : uint64_t per class
+//   r matrix      : float per class pair, row major, if the header says there is one
+//   params        : the generator's parameters, as text, not null terminated
+//   x             : float per point, sorted by class, so class c's points are a contiguous range
+//   y             : float per point, in the same order
+// Everything is little endian. Offsets in the header are from the start of the file.
+
+namespace PointFile
+{
+    static const char c_magic[8] = { 'M', 'C', 'B', 'N', 'P', 'T', 'S', '\0' };
+    static const uint32_t c_version = 1;
+    static const uint64_t c_alignment = 64;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t classCount;
+        uint32_t hasRMatrix;
+        uint64_t pointCount;
+        uint64_t seed;
+        uint64_t classCountsOffset;
+        uint64_t rMatrixOffset;
+        uint64_t paramsOffset;
+        uint64_t paramsSize;
+        uint64_t xOffset;
+        uint64_t yOffset;
+    };
+
+    // What is known about how the points were made. Everything is optional.
+    struct Info
+    {
+        uint64_t seed = 0;
+        std::vector<float> rMatrix;     // classCount * classCount, row major, or empty
+        std::string params;
+    };
+
+    // A generator's r matrix, in the order of the classes the user asked for. The generators keep their r matrix in
+    // the order of their sorted layers, and each layer has the original index of its class.
+    template <size_t N, typename TLayer>
+    std::vector<float> UnsortRMatrix(const std::array<std::array<float, N>, N>& rMatrix, const std::vector<TLayer>& sortedLayers)
+    {
+        std::vector<float> ret(N * N, 0.0f);
+        for (size_t i = 0; i < N; ++i)
+        {
+            for (size_t j = 0; j < N; ++j)
+                ret[sortedLayers[i].originalIndex * N + sortedLayers[j].originalIndex] = rMatrix[i][j];
+        }
+        return ret;
+    }
+
+    // Appends a number to a params string, as name=value
+    inline void AppendParam(std::string& params, const char* name, double value)
+    {
+        char buffer[64];
+        sprintf(buffer, "%s%s=%g", params.empty() ? "" : " ", name, value);
+        params += buffer;
+    }
+
+    // Appends a list of numbers to a params string, as name=a,b,c
+    template <typename T, size_t N>
+    void AppendParam(std::string& params, const char* name, const T(&values)[N])
+    {
+        char buffer[64];
+        params += params.empty() ? "" : " ";
+        params += name;
+        params += "=";
+        for (size_t i = 0; i < N; ++i)
+        {
+            sprintf(buffer, (i > 0) ? ",%g" : "%g", double(values[i]));
+            params += buffer;
+        }
+    }
+
+    inline uint64_t AlignUp(uint64_t offset)
+    {
+        return (offset + c_alignment - 1) & ~(c_alignment - 1);
+    }
+
+    inline bool Write(const char* fileName, const std::vector<Point>& points, const Info& info = Info())
+    {
+        // sort the points by class, as SoA. Points without a class (a negative class index) aren't written.
+        uint32_t classCount = 0;
+        for (const Point& p : points)
+        {
+            if (p.classIndex >= 0)
+                classCount = std::max(classCount, uint32_t(p.classIndex + 1));
+        }
+        std::vector<uint64_t> classCounts(classCount, 0);
+        uint64_t pointCount = 0;
+        for (const Point& p : points)
+        {
+            if (p.classIndex >= 0)
+            {
+                classCounts[p.classIndex]++;
+                pointCount++;
+            }
+        }
+        if (pointCount < points.size())
+            printf("PointFile::Write(): skipping %i points with no class in %s\n", int(points.size() - pointCount), fileName);
+
+        std::vector<uint64_t> classStarts(classCount, 0);
+        for (uint32_t i = 1; i < classCount; ++i)
+            classStarts[i] = classStarts[i - 1] + classCounts[i - 1];
+
+        std::vector<float> xs(pointCount);
+        std::vector<float> ys(pointCount);
+        for (const Point& p : points)
+        {
+            if (p.classIndex < 0)
+                continue;
+            uint64_t index = classStarts[p.classIndex]++;
+            xs[index] = p.v[0];
+            ys[index] = p.v[1];
+        }
+
+        bool hasRMatrix = info.rMatrix.size() == size_t(classCount) * size_t(classCount) && classCount > 0;
+
+        // lay out the sections
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, c_magic, sizeof(c_magic));
+        header.version = c_version;
+        header.headerSize = sizeof(Header);
+        header.classCount = classCount;
+        header.hasRMatrix = hasRMatrix ? 1 : 0;
+        header.pointCount = pointCount;
+        header.seed = info.seed;
+        header.classCountsOffset = AlignUp(sizeof(Header));
+        header.rMatrixOffset = AlignUp(header.classCountsOffset + classCount * sizeof(uint64_t));
+        header.paramsOffset = AlignUp(header.rMatrixOffset + (hasRMatrix ? info.rMatrix.size() * sizeof(float) : 0));
+        header.paramsSize = info.params.size();
+        header.xOffset = AlignUp(header.paramsOffset + header.paramsSize);
+        header.yOffset = AlignUp(header.xOffset + pointCount * sizeof(float));
+
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "wb");
+        if (!file)
+        {
+            printf("PointFile::Write(): could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        // writes a section, padding with zeros up to its offset first
+        uint64_t position = 0;
+        auto WriteSection = [&](uint64_t offset, const void* data, size_t size)
+        {
+            static const char c_zeros[c_alignment] = {};
+            if (offset > position)
+                fwrite(c_zeros, 1, size_t(offset - position), file);
+            if (size > 0)
+                fwrite(data, 1, size, file);
+            position = offset + size;
+        };
+
+        WriteSection(0, &header, sizeof(header));
+        WriteSection(header.classCountsOffset, classCounts.data(), classCounts.size() * sizeof(uint64_t));
+        if (hasRMatrix)
+            WriteSection(header.rMatrixOffset, info.rMatrix.data(), info.rMatrix.size() * sizeof(float));
+        WriteSection(header.paramsOffset, info.params.data(), info.params.size());
+        WriteSection(header.xOffset, xs.data(), xs.size() * sizeof(float));
+        WriteSection(header.yOffset, ys.data(), ys.size() * sizeof(float));
+
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    // Memory maps a point file, and gives pointers straight into it
+    class Reader
+    {
+    public:
+        Reader() = default;
+        Reader(const Reader&) = delete;
+        Reader& operator = (const Reader&) = delete;
+
+        ~Reader()
+        {
+            Close();
+        }
+
+        bool Open(const char* fileName)
+        {
+            Close();
+
+            if (!m_file.Open(fileName))
+                return Fail("could not open", fileName);
+            m_data = m_file.Data();
+            m_size = m_file.Size();
+            if (m_size < sizeof(Header))
+                return Fail("too small to be a point file:", fileName);
+
+            // check that the header and sections make sense before anything uses them
+            const Header& header = GetHeader();
+            if (memcmp(header.magic, c_magic, sizeof(c_magic)) != 0)
+                return Fail("not a point file:", fileName);
+            if (header.version != c_version || header.headerSize != sizeof(Header))
+                return Fail("unsupported point file version:", fileName);
+
+            uint64_t rMatrixSize = header.hasRMatrix ? uint64_t(header.classCount) * header.classCount * sizeof(float) : 0;
+            if (!SectionFits(header.classCountsOffset, uint64_t(header.classCount) * sizeof(uint64_t)) ||
+                !SectionFits(header.rMatrixOffset, rMatrixSize) ||
+                !SectionFits(header.paramsOffset, header.paramsSize) ||
+                !SectionFits(header.xOffset, header.pointCount * sizeof(float)) ||
+                !SectionFits(header.yOffset, header.pointCount * sizeof(float)))
+                return Fail("truncated point file:", fileName);
+
+            // where each class starts in x and y
+            m_classStarts.resize(header.classCount + 1, 0);
+            const uint64_t* classCounts = (const uint64_t*)&m_data[header.classCountsOffset];
+            for (uint32_t i = 0; i < header.classCount; ++i)
+                m_classStarts[i + 1] = m_classStarts[i] + classCounts[i];
+            if (m_classStarts[header.classCount] != header.pointCount)
+                return Fail("class counts don't add up in", fileName);
+
+            return true;
+        }
+
+        void Close()
+        {
+            m_file.Close();
+            m_data = nullptr;
+            m_size = 0;
+            m_classStarts.clear();
+        }
+
+        bool IsOpen() const
+        {
+            return m_data != nullptr;
+        }
+
+        const Header& GetHeader() const
+        {
+            return *(const Header*)m_data;
+        }
+
+        int ClassCount() const
+        {
+            return int(GetHeader().classCount);
+        }
+
+        uint64_t PointCount() const
+        {
+            return GetHeader().pointCount;
+        }
+
+        uint64_t ClassPointCount(int classIndex) const
+        {
+            return m_classStarts[classIndex + 1] - m_classStarts[classIndex];
+        }
+
+        uint64_t Seed() const
+        {
+            return GetHeader().seed;
+        }
+
+        // classCount * classCount floats, or nullptr if the file doesn't have an r matrix
+        const float* RMatrix() const
+        {
+            return GetHeader().hasRMatrix ? (const float*)&m_data[GetHeader().rMatrixOffset] : nullptr;
+        }
+
+        std::string Params() const
+        {
+            return std::string((const char*)&m_data[GetHeader().paramsOffset], size_t(GetHeader().paramsSize));
+        }
+
+        // The x and y values of a class's points, ClassPointCount() of each
+        const float* X(int classIndex) const
+        {
+            return (const float*)&m_data[GetHeader().xOffset] + m_classStarts[classIndex];
+        }
+
+        const float* Y(int classIndex) const
+        {
+            return (const float*)&m_data[GetHeader().yOffset] + m_classStarts[classIndex];
+        }
+
+        // A copy of the points, for the code that works with std::vector<Point>
+        std::vector<Point> ToPoints() const
+        {
+            std::vector<Point> ret;
+            ret.reserve(size_t(PointCount()));
+            for (int classIndex = 0; classIndex < ClassCount(); ++classIndex)
+            {
+                const float* xs = X(classIndex);
+                const float* ys = Y(classIndex);
+                for (uint64_t i = 0; i < ClassPointCount(classIndex); ++i)
+                    ret.push_back({ classIndex, Vec2{ xs[i], ys[i] } });
+            }
+            return ret;
+        }
+
+    private:
+        bool Fail(const char* message, const char* fileName)
+        {
+            printf("PointFile::Reader: %s %s\n", message, fileName);
+            Close();
+            return false;
+        }
+
+        bool SectionFits(uint64_t offset, uint64_t size) const
+        {
+            return offset % c_alignment == 0 && offset <= m_size && size <= m_size - offset;
+        }
+
+        MappedFile m_file;
+        const unsigned char* m_data = nullptr;
+        uint64_t m_size = 0;
+        std::vector<uint64_t> m_classStarts;
+    };
+};
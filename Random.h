@@ -5,17 +5,23 @@
 #include "pcg/pcg_basic.h"
 #include <random>
 
-inline pcg32_random_t GetRNG()
+inline uint64_t GetSeed()
 {
-    pcg32_random_t rng;
 #if DETERMINISTIC()
-    pcg32_srandom_r(&rng, 0x1337FEED, 0);
+    return 0x1337FEED;
 #else
     std::random_device device;
     std::mt19937 generator(device());
     std::uniform_int_distribution<uint32_t> dist;
-    pcg32_srandom_r(&rng, dist(generator), 0);
+    return dist(generator);
 #endif
+}
+
+// RNGs with the same seed and different streams give independent values
+inline pcg32_random_t GetRNG(uint64_t seed = GetSeed(), uint64_t stream = 0)
+{
+    pcg32_random_t rng;
+    pcg32_srandom_r(&rng, seed, stream);
     return rng;
 }
 
@@ -28,3 +34,121 @@ inline uint32_t RandomUint32(pcg32_random_t& rng, uint32_t bound)
 {
     return pcg32_boundedrand_r(&rng, bound);
 }
+
+// ============================== Counter based RNG ==============================
+// Philox4x32-10 (Salmon et al. 2011, "Parallel Random Numbers: As Easy as 1, 2, 3").
+// Values are a pure function of (seed, realization, trial index), so output is the same
+// no matter how many threads ran or how the work was split up between them.
+
+inline void Philox4x32(const uint32_t(&counter)[4], const uint32_t(&key)[2], uint32_t(&out)[4])
+{
+    uint32_t c[4] = { counter[0], counter[1], counter[2], counter[3] };
+    uint32_t k[2] = { key[0], key[1] };
+    for (int round = 0; round < 10; ++round)
+    {
+        uint64_t product0 = uint64_t(0xD2511F53) * uint64_t(c[0]);
+        uint64_t product1 = uint64_t(0xCD9E8D57) * uint64_t(c[2]);
+        uint32_t next[4] =
+        {
+            uint32_t(product1 >> 32) ^ c[1] ^ k[0],
+            uint32_t(product1),
+            uint32_t(product0 >> 32) ^ c[3] ^ k[1],
+            uint32_t(product0)
+        };
+        c[0] = next[0]; c[1] = next[1]; c[2] = next[2]; c[3] = next[3];
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+    }
+    out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+}
+
+// The 4 random values belonging to a single trial. Parallel code can call this directly, with
+// whatever trial index it is working on.
+inline void CounterRandomUint32x4(uint64_t seed, uint32_t realization, uint64_t trialIndex, uint32_t(&out)[4])
+{
+    const uint32_t counter[4] = { uint32_t(trialIndex), uint32_t(trialIndex >> 32), realization, 0 };
+    const uint32_t key[2] = { uint32_t(seed), uint32_t(seed >> 32) };
+    Philox4x32(counter, key, out);
+}
+
+inline float CounterRandomFloat01(uint64_t seed, uint32_t realization, uint64_t trialIndex, int component)
+{
+    uint32_t values[4];
+    CounterRandomUint32x4(seed, realization, trialIndex, values);
+    return float(values[component]) / 4294967295.0f;
+}
+
+// Which realization the counter RNGs are making values for. main() sets this before each realization,
+// so that realization i gives the same points regardless of what ran before it.
+inline uint32_t& RNGRealization()
+{
+    static uint32_t realization = 0;
+    return realization;
+}
+
+// Sequential wrapper, usable anywhere a pcg32_random_t is, through RandomFloat01() and RandomUint32().
+// Each trial index gives 4 values, which get used up in order.
+struct CounterRNG
+{
+    uint64_t seed = 0;
+    uint32_t realization = 0;
+    uint64_t trialIndex = 0;
+    uint32_t values[4] = {};
+    int nextValue = 4;
+};
+
+// Each stream gets its own Philox key, made from the seed
+inline CounterRNG GetCounterRNG(uint64_t seed = GetSeed(), uint64_t stream = 0)
+{
+    CounterRNG rng;
+    rng.seed = seed + stream * 0x9E3779B97F4A7C15ull;
+    rng.realization = RNGRealization();
+    return rng;
+}
+
+inline uint32_t CounterRandomUint32(CounterRNG& rng)
+{
+    // start the stream over when the realization changes
+    if (rng.realization != RNGRealization())
+    {
+        rng.realization = RNGRealization();
+        rng.trialIndex = 0;
+        rng.nextValue = 4;
+    }
+
+    if (rng.nextValue == 4)
+    {
+        CounterRandomUint32x4(rng.seed, rng.realization, rng.trialIndex, rng.values);
+        rng.trialIndex++;
+        rng.nextValue = 0;
+    }
+    return rng.values[rng.nextValue++];
+}
+
+inline float RandomFloat01(CounterRNG& rng)
+{
+    return float(CounterRandomUint32(rng)) / 4294967295.0f;
+}
+
+inline uint32_t RandomUint32(CounterRNG& rng, uint32_t bound)
+{
+    // same rejection as pcg32_boundedrand_r
+    uint32_t threshold = (~bound + 1u) % bound;
+    while (true)
+    {
+        uint32_t r = CounterRandomUint32(rng);
+        if (r >= threshold)
+            return r % bound;
+    }
+}
+
+// Set to true to have the RNG functions in main.cpp use the counter based RNG instead of PCG
+#define COUNTER_RNG() false
+
+#if COUNTER_RNG()
+typedef CounterRNG TRNG;
+inline TRNG GetTRNG(uint64_t seed = GetSeed(), uint64_t stream = 0) { return GetCounterRNG(seed, stream); }
+#else
+typedef pcg32_random_t TRNG;
+inline TRNG GetTRNG(uint64_t seed = GetSeed(), uint64_t stream = 0) { return GetRNG(seed, stream); }
+#endif
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+
+#include "Random.h"
+#include "MathUtils.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// 8 independent PCG32 streams, stepped together in AVX2 lanes.
+// Lane i is seeded exactly like pcg32_srandom_r(&rng, seed, firstStream + i), and produces the same
+// sequence of values as the scalar generator would, so results don't depend on whether AVX2 is available.
+struct PCG32x8
+{
+    static const int c_lanes = 8;
+
+    alignas(32) uint64_t state[c_lanes];
+    alignas(32) uint64_t inc[c_lanes];
+
+    void Seed(uint64_t seed, uint64_t firstStream = 0)
+    {
+        for (int i = 0; i < c_lanes; ++i)
+        {
+            pcg32_random_t rng;
+            pcg32_srandom_r(&rng, seed, firstStream + i);
+            state[i] = rng.state;
+            inc[i] = rng.inc;
+        }
+    }
+
+    // Writes one uint32 per lane
+    void Next(uint32_t* out)
+    {
+#if defined(__AVX2__)
+        const __m256i mulLo = _mm256_set1_epi64x(6364136223846793005ULL & 0xFFFFFFFFULL);
+        const __m256i mulHi = _mm256_set1_epi64x(6364136223846793005ULL >> 32);
+        const __m256i packIndices = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        const __m256i thirtyTwo = _mm256_set1_epi32(32);
+
+        __m256i xorshifted[2];
+        __m256i rot[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m256i oldState = _mm256_load_si256((const __m256i*)&state[half * 4]);
+            __m256i increment = _mm256_load_si256((const __m256i*)&inc[half * 4]);
+
+            // state = state * multiplier + inc, with the 64 bit multiply built from 32 bit ones
+            __m256i lo = _mm256_mul_epu32(oldState, mulLo);
+            __m256i cross = _mm256_add_epi64(
+                _mm256_mul_epu32(_mm256_srli_epi64(oldState, 32), mulLo),
+                _mm256_mul_epu32(oldState, mulHi)
+            );
+            __m256i newState = _mm256_add_epi64(_mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32)), increment);
+            _mm256_store_si256((__m256i*)&state[half * 4], newState);
+
+            // output function, on the old state. Only the low 32 bits of each lane matter.
+            xorshifted[half] = _mm256_srli_epi64(_mm256_xor_si256(_mm256_srli_epi64(oldState, 18), oldState), 27);
+            rot[half] = _mm256_srli_epi64(oldState, 59);
+
+            // gather the low 32 bits of the 4 lanes into the low 128 bits
+            xorshifted[half] = _mm256_permutevar8x32_epi32(xorshifted[half], packIndices);
+            rot[half] = _mm256_permutevar8x32_epi32(rot[half], packIndices);
+        }
+
+        __m256i x = _mm256_permute2x128_si256(xorshifted[0], xorshifted[1], 0x20);
+        __m256i r = _mm256_permute2x128_si256(rot[0], rot[1], 0x20);
+
+        // rotate right. a left shift by 32 gives 0, which handles rot == 0 the same as the scalar code.
+        __m256i result = _mm256_or_si256(_mm256_srlv_epi32(x, r), _mm256_sllv_epi32(x, _mm256_sub_epi32(thirtyTwo, r)));
+        _mm256_storeu_si256((__m256i*)out, result);
+#else
+        for (int i = 0; i < c_lanes; ++i)
+        {
+            pcg32_random_t rng = { state[i], inc[i] };
+            out[i] = pcg32_random_r(&rng);
+            state[i] = rng.state;
+        }
+#endif
+    }
+
+    // Writes one float in [0,1] per lane, the same value RandomFloat01() would give for that lane's stream
+    void NextFloat01(float* out)
+    {
+        alignas(32) uint32_t values[c_lanes];
+        Next(values);
+#if defined(__AVX2__)
+        // there is no unsigned int to float conversion, so convert the high and low 16 bits separately.
+        // Both halves convert exactly, so the add does the only rounding, same as float(uint32_t).
+        __m256i v = _mm256_load_si256((const __m256i*)values);
+        __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16)), _mm256_set1_ps(65536.0f));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)));
+        __m256 f = _mm256_div_ps(_mm256_add_ps(hi, lo), _mm256_set1_ps(4294967295.0f));
+        _mm256_storeu_ps(out, f);
+#else
+        for (int i = 0; i < c_lanes; ++i)
+            out[i] = float(values[i]) / 4294967295.0f;
+#endif
+    }
+};
+
+// A candidate source for the generators which makes 2D candidates 8 at a time.
+// Candidate i of each batch of 8 comes from lane i, x then y, so every lane yields exactly the
+// points that RNGContinuous would with a pcg32 seeded to that lane's stream.
+class BatchedRNGContinuous
+{
+public:
+    BatchedRNGContinuous(uint64_t seed = GetSeed())
+    {
+        m_rng.Seed(seed);
+    }
+
+    Vec2 operator()()
+    {
+        if (m_next == PCG32x8::c_lanes)
+            Refill();
+
+        Vec2 ret = Vec2{ m_x[m_next], m_y[m_next] };
+        m_next++;
+        return ret;
+    }
+
+    // Fill arrays of candidate coordinates in bulk.
+    // Continues the same sequence that operator() gives.
+    void Fill(float* xs, float* ys, size_t count)
+    {
+        size_t index = 0;
+
+        // use up what's left of the current batch
+        while (index < count && m_next < PCG32x8::c_lanes)
+        {
+            xs[index] = m_x[m_next];
+            ys[index] = m_y[m_next];
+            m_next++;
+            index++;
+        }
+
+        // whole batches go straight to the destination
+        while (count - index >= PCG32x8::c_lanes)
+        {
+            m_rng.NextFloat01(&xs[index]);
+            m_rng.NextFloat01(&ys[index]);
+            index += PCG32x8::c_lanes;
+        }
+
+        // and the remainder comes from a new batch
+        while (index < count)
+        {
+            if (m_next == PCG32x8::c_lanes)
+                Refill();
+            xs[index] = m_x[m_next];
+            ys[index] = m_y[m_next];
+            m_next++;
+            index++;
+        }
+    }
+
+private:
+    void Refill()
+    {
+        m_rng.NextFloat01(m_x);
+        m_rng.NextFloat01(m_y);
+        m_next = 0;
+    }
+
+    PCG32x8 m_rng;
+    float m_x[PCG32x8::c_lanes];
+    float m_y[PCG32x8::c_lanes];
+    int m_next = PCG32x8::c_lanes;
+};
+
+// Makes count 2D candidates with rng. RNGs that have a bulk Fill(), like BatchedRNGContinuous, fill xs and ys with it,
+// and others are called once per candidate. Either way, the candidates are the same as calling rng() count times.
+template <typename RNG>
+auto FillCandidates(RNG& rng, Vec2* candidates, int count, std::vector<float>& xs, std::vector<float>& ys, int)
+    -> decltype(rng.Fill((float*)nullptr, (float*)nullptr, size_t(0)), void())
+{
+    xs.resize(count);
+    ys.resize(count);
+    rng.Fill(xs.data(), ys.data(), size_t(count));
+    for (int i = 0; i < count; ++i)
+        candidates[i] = Vec2{ xs[i], ys[i] };
+}
+
+template <typename RNG>
+void FillCandidates(RNG& rng, Vec2* candidates, int count, std::vector<float>& xs, std::vector<float>& ys, long)
+{
+    for (int i = 0; i < count; ++i)
+        candidates[i] = rng();
+}
+
+template <typename RNG>
+void FillCandidates(RNG& rng, Vec2* candidates, int count, std::vector<float>& xs, std::vector<float>& ys)
+{
+    FillCandidates(rng, candidates, count, xs, ys, 0);
+}
+
+// Discrete candidates for HardAdaptive, same interface as RNGDiscreteParams.
+// Bounded values use the same rejection as pcg32_boundedrand_r, on the interleaved lane outputs.
+class BatchedRNGDiscreteParams
+{
+public:
+    BatchedRNGDiscreteParams(uint64_t seed = GetSeed())
+    {
+        m_rng.Seed(seed);
+    }
+
+    Vec2u operator()(int X, int Y)
+    {
+        uint32_t x = BoundedRand(X);
+        uint32_t y = BoundedRand(Y);
+        return Vec2u{ x, y };
+    }
+
+private:
+    uint32_t NextUint32()
+    {
+        if (m_next == PCG32x8::c_lanes)
+        {
+            m_rng.Next(m_values);
+            m_next = 0;
+        }
+        return m_values[m_next++];
+    }
+
+    uint32_t BoundedRand(uint32_t bound)
+    {
+        uint32_t threshold = (~bound + 1u) % bound;
+        while (true)
+        {
+            uint32_t r = NextUint32();
+            if (r >= threshold)
+                return r % bound;
+        }
+    }
+
+    PCG32x8 m_rng;
+    uint32_t m_values[PCG32x8::c_lanes];
+    int m_next = PCG32x8::c_lanes;
+};
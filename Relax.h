@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Grid.h"
+#include "ThreadPool.h"
+
+// Multi class Lloyd relaxation on the torus, to post optimize the points made by any of the generators.
+// Each iteration moves every point to the centroid of its Voronoi cell, with the cells made from the points near it,
+// found with grids. As in the r matrix, a point of class c is constrained by its own class, spaced rMatrix[c][c] apart,
+// and by each priority group from its own to the densest, along with all the sparser groups, spaced rMatrix[c][j] apart.
+// Iterations cycle through those sets like multi class Lloyd does: first each class relaxes on its own, then each
+// priority group relaxes along with the sparser groups, from sparsest to densest. All points move at once, from the
+// positions of the last iteration, so the points are split across the thread pool.
+//
+// Lloyd relaxation makes points more evenly spaced, but run to convergence it makes them regular, and loses
+// the blue noise. A few iterations, or a loose convergence threshold, are usually what is wanted.
+
+namespace Relax
+{
+    struct Settings
+    {
+        int maxIterations = 20;
+
+        // stop when the average point moves less than this in a whole cycle, as a fraction of its own class's radius
+        float convergenceThreshold = 0.01f;
+
+        bool multithreaded = true;
+    };
+
+    // The point a cell is made for is at the origin, and neighbors are relative to it
+    struct CellScratch
+    {
+        std::vector<int> neighbors;
+        std::vector<Vec2> polygon;
+        std::vector<Vec2> clipped;
+        float maxDistanceSq = 0.0f;     // of the polygon's farthest vertex
+    };
+
+    // A set of classes that constrain each other, and their spacing
+    struct ClassSet
+    {
+        std::vector<bool> classMask;
+        float radius = 0.0f;
+    };
+
+    // the shortest offset from A to B on the unit torus
+    inline Vec2 ToroidalOffset(const Vec2& A, const Vec2& B)
+    {
+        Vec2 ret = B - A;
+        for (float& f : ret)
+        {
+            if (f > 0.5f)
+                f -= 1.0f;
+            else if (f < -0.5f)
+                f += 1.0f;
+        }
+        return ret;
+    }
+
+    // Clips the polygon to the half plane closer to the origin than to the neighbor (Sutherland-Hodgman)
+    inline void ClipToBisector(const Vec2& neighbor, CellScratch& scratch)
+    {
+        float limit = Dot(neighbor, neighbor) * 0.5f;
+
+        scratch.clipped.clear();
+        for (size_t i = 0; i < scratch.polygon.size(); ++i)
+        {
+            const Vec2& A = scratch.polygon[i];
+            const Vec2& B = scratch.polygon[(i + 1) % scratch.polygon.size()];
+            float a = Dot(A, neighbor) - limit;
+            float b = Dot(B, neighbor) - limit;
+
+            if (a <= 0.0f)
+                scratch.clipped.push_back(A);
+            if ((a <= 0.0f) != (b <= 0.0f))
+            {
+                float t = a / (a - b);
+                scratch.clipped.push_back(Vec2{ Lerp(A[0], B[0], t), Lerp(A[1], B[1], t) });
+            }
+        }
+        std::swap(scratch.polygon, scratch.clipped);
+
+        scratch.maxDistanceSq = 0.0f;
+        for (const Vec2& v : scratch.polygon)
+            scratch.maxDistanceSq = std::max(scratch.maxDistanceSq, Dot(v, v));
+    }
+
+    // The centroid of the Voronoi cell of points[pointIndex], among the points of the classes in classMask, relative to the point.
+    // Points farther than 3 * radius away are ignored, and the cell is limited to a square that they can't clip.
+    inline Vec2 CellCentroid(const std::vector<Point>& points, int pointIndex, const ClassSet& classSet, const std::vector<Grid<100, 100>>& grids, CellScratch& scratch)
+    {
+        const Vec2& p = points[pointIndex].v;
+        float searchRadius = std::min(classSet.radius * 3.0f, 0.5f);
+        float halfSize = searchRadius * 0.35f;
+
+        scratch.polygon.clear();
+        scratch.polygon.push_back(Vec2{ -halfSize, -halfSize });
+        scratch.polygon.push_back(Vec2{ halfSize, -halfSize });
+        scratch.polygon.push_back(Vec2{ halfSize, halfSize });
+        scratch.polygon.push_back(Vec2{ -halfSize, halfSize });
+        scratch.maxDistanceSq = 2.0f * halfSize * halfSize;
+
+        scratch.neighbors.clear();
+        for (size_t classIndex = 0; classIndex < grids.size(); ++classIndex)
+        {
+            if (classSet.classMask[classIndex])
+                grids[classIndex].GetPoints<true>(p[0], p[1], searchRadius, scratch.neighbors, false);
+        }
+
+        for (int neighborIndex : scratch.neighbors)
+        {
+            // neighbors whose bisector is beyond the polygon's farthest vertex can't clip it
+            Vec2 offset = ToroidalOffset(p, points[neighborIndex].v);
+            float distanceSq = Dot(offset, offset);
+            if (neighborIndex == pointIndex || distanceSq == 0.0f || distanceSq >= 4.0f * scratch.maxDistanceSq)
+                continue;
+            ClipToBisector(offset, scratch);
+            if (scratch.polygon.empty())
+                return Vec2{ 0.0f, 0.0f };
+        }
+
+        // area weighted centroid of the polygon
+        float area = 0.0f;
+        Vec2 centroid = Vec2{ 0.0f, 0.0f };
+        for (size_t i = 0; i < scratch.polygon.size(); ++i)
+        {
+            const Vec2& A = scratch.polygon[i];
+            const Vec2& B = scratch.polygon[(i + 1) % scratch.polygon.size()];
+            float cross = A[0] * B[1] - B[0] * A[1];
+            area += cross;
+            centroid[0] += (A[0] + B[0]) * cross;
+            centroid[1] += (A[1] + B[1]) * cross;
+        }
+        if (area <= 0.0f)
+            return Vec2{ 0.0f, 0.0f };
+
+        centroid[0] /= 3.0f * area;
+        centroid[1] /= 3.0f * area;
+        return centroid;
+    }
+
+    inline std::vector<Point> Lloyd(const std::vector<Point>& points, const Settings& settings = Settings())
+    {
+        // points with no class (a negative class index) don't take part, and are carried through unmoved
+        std::vector<Point> ret;
+        std::vector<int> retIndices;
+        ret.reserve(points.size());
+        retIndices.reserve(points.size());
+        for (int i = 0; i < (int)points.size(); ++i)
+        {
+            if (points[i].classIndex >= 0)
+            {
+                ret.push_back(points[i]);
+                retIndices.push_back(i);
+            }
+        }
+        if (ret.size() < points.size())
+            printf("Relax::Lloyd(): leaving %i points with no class where they are\n", int(points.size() - ret.size()));
+
+        // count the classes
+        int classCount = 0;
+        for (const Point& p : ret)
+            classCount = std::max(classCount, p.classIndex + 1);
+        std::vector<int> counts(classCount, 0);
+        for (const Point& p : ret)
+            counts[p.classIndex]++;
+
+        // the radius of each class
+        std::vector<float> radius(classCount, 0.0f);
+        for (int i = 0; i < classCount; ++i)
+        {
+            float packing_density = c_pi * std::sqrt(3.0f) / 6.0f;
+            radius[i] = (counts[i] > 0) ? 2.0f * std::pow(packing_density / (c_pi * float(counts[i])), 1.0f / 2.0f) : 0.0f;
+        }
+
+        // the sets of classes, after each class on its own: each priority group with all of the sparser groups.
+        // The sparsest group is skipped if it is a single class.
+        std::vector<ClassSet> groupSets;
+        {
+            std::vector<float> groupRadii;
+            for (int i = 0; i < classCount; ++i)
+            {
+                if (counts[i] > 0 && std::find(groupRadii.begin(), groupRadii.end(), radius[i]) == groupRadii.end())
+                    groupRadii.push_back(radius[i]);
+            }
+            std::sort(groupRadii.begin(), groupRadii.end(), [](float A, float B) { return A > B; });
+
+            for (float groupRadius : groupRadii)
+            {
+                ClassSet groupSet;
+                groupSet.classMask.resize(classCount, false);
+                float totalDensity = 0.0f;
+                int setClassCount = 0;
+                for (int j = 0; j < classCount; ++j)
+                {
+                    if (counts[j] > 0 && radius[j] >= groupRadius)
+                    {
+                        groupSet.classMask[j] = true;
+                        totalDensity += 1.0f / (radius[j] * radius[j]);
+                        setClassCount++;
+                    }
+                }
+                groupSet.radius = 1.0f / std::sqrt(totalDensity);
+                if (setClassCount > 1)
+                    groupSets.push_back(groupSet);
+            }
+        }
+        std::vector<ClassSet> ownClassSets(classCount);
+        for (int i = 0; i < classCount; ++i)
+        {
+            ownClassSets[i].classMask.resize(classCount, false);
+            ownClassSets[i].classMask[i] = true;
+            ownClassSets[i].radius = radius[i];
+        }
+        int cycleLength = 1 + (int)groupSets.size();
+
+        ThreadPool& threadPool = GetThreadPool();
+        std::vector<CellScratch> scratch(settings.multithreaded ? threadPool.ThreadCount() : 1);
+        std::vector<Vec2> newPositions(ret.size());
+        std::vector<float> movement(ret.size());
+
+        double cycleMovement = 0.0;
+        for (int iteration = 0; iteration < settings.maxIterations; ++iteration)
+        {
+            std::vector<Grid<100, 100>> grids(classCount);
+            for (int i = 0; i < (int)ret.size(); ++i)
+                grids[ret[i].classIndex].AddPoint(i, ret[i].v[0], ret[i].v[1]);
+
+            int step = iteration % cycleLength;
+            auto DoPoint = [&](int index, int threadIndex)
+            {
+                int c = ret[index].classIndex;
+                newPositions[index] = ret[index].v;
+                movement[index] = 0.0f;
+
+                const ClassSet& classSet = (step == 0) ? ownClassSets[c] : groupSets[step - 1];
+                if (!classSet.classMask[c])
+                    return;
+
+                Vec2 offset = CellCentroid(ret, index, classSet, grids, scratch[threadIndex]);
+                Vec2& v = newPositions[index];
+                for (int i = 0; i < 2; ++i)
+                {
+                    v[i] += offset[i];
+                    v[i] -= std::floor(v[i]);
+                    v[i] = std::min(v[i], 0.99999994f);
+                }
+                movement[index] = std::sqrt(Dot(offset, offset)) / radius[c];
+            };
+
+            if (settings.multithreaded)
+                threadPool.ParallelFor((int)ret.size(), DoPoint, 256);
+            else
+            {
+                for (int i = 0; i < (int)ret.size(); ++i)
+                    DoPoint(i, 0);
+            }
+
+            double totalMovement = 0.0;
+            for (int i = 0; i < (int)ret.size(); ++i)
+            {
+                ret[i].v = newPositions[i];
+                totalMovement += movement[i];
+            }
+            cycleMovement += ret.empty() ? 0.0 : totalMovement / double(ret.size());
+
+            if (step == cycleLength - 1)
+            {
+                printf("\rLloyd iteration %i: average movement %f", iteration + 1, float(cycleMovement));
+                if (cycleMovement < settings.convergenceThreshold)
+                    break;
+                cycleMovement = 0.0;
+            }
+        }
+        printf("\n");
+
+        std::vector<Point> output = points;
+        for (int i = 0; i < (int)ret.size(); ++i)
+            output[retIndices[i]] = ret[i];
+        return output;
+    }
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "Grid.h"
+#include "IndexToColor.h"
+#include "MathUtils.h"
+#include "ThreadPool.h"
+
+// Images of multi class point sets, for each subset of the classes.
+//
+// Every class is drawn once, into its own layers: a coverage layer that says how much of each pixel the class's dots
+// cover, and a hit layer of the pixels that have a point in them. An image of any subset of classes is then made by
+// compositing the layers of the classes in it, so drawing costs classCount passes over the points, rather than one
+// pass per subset, and only the subsets that are asked for are made.
+//
+// A class's dots are all the same color, so drawing them over each other is the same as drawing them into a coverage
+// layer that builds up as 1 - (1 - a) * (1 - alpha), and compositing it on top. Dots of different classes are
+// composited in class order, rather than the order of the points.
+//
+// Dots are drawn with stamps. The dot radius is the same for a whole image, so the alpha of every pixel around a dot
+// is worked out once for each sub pixel offset of the dot's center, as 8 bit values. Drawing a dot is then integer
+// blending of a stamp into the layer. Stamp rows are padded with zeros to a multiple of 8 pixels, so they can be blended
+// 8 pixels at a time with SIMD.
+//
+// The image is split into tiles, which are drawn in parallel. Points are binned into a Grid with a cell per tile, in
+// the cell of every tile their dot reaches, wrapping around the edges of the image. A tile draws the dots in its cell,
+// clipped to the tile, so no two threads write the same pixel. Dots that wrapped around to reach a tile are moved by
+// the image size, which works for dots less than half the size of the image. Compositing is done in parallel over rows.
+
+namespace SampleImages
+{
+    struct Layers
+    {
+        int imageSize = 0;
+        int classCount = 0;
+        std::vector<std::vector<unsigned char>> coverage;   // per class, from 0 to 255. Empty if not drawn.
+        std::vector<std::vector<unsigned char>> hits;       // per class, 1 where there's a point. Empty if not drawn.
+    };
+
+    inline void ClassColor(int classIndex, unsigned char(&RGB)[3])
+    {
+        Vec3 RGBf = IndexToColor(classIndex, 1.0f, 0.95f);
+        RGB[0] = (unsigned char)Clamp(RGBf[0] * 256.0f, 0.0f, 255.0f);
+        RGB[1] = (unsigned char)Clamp(RGBf[1] * 256.0f, 0.0f, 255.0f);
+        RGB[2] = (unsigned char)Clamp(RGBf[2] * 256.0f, 0.0f, 255.0f);
+    }
+
+    // The pixel that a point is in
+    inline void PointPixel(const Point& p, int imageSize, int& x, int& y)
+    {
+        x = (int)Clamp(p.v[0] * float(imageSize), 0.0f, float(imageSize - 1));
+        y = (int)Clamp(p.v[1] * float(imageSize), 0.0f, float(imageSize - 1));
+    }
+
+    // x * y / 255, rounded, for x and y in [0, 255]
+    inline unsigned int MulDiv255(unsigned int x, unsigned int y)
+    {
+        unsigned int product = x * y + 128;
+        return (product + (product >> 8)) >> 8;
+    }
+
+    // The alpha of a dot around its center, for each sub pixel offset of the center
+    struct DotStamps
+    {
+        static const int c_subpixelSteps = 4;
+
+        int padding = 0;    // how many pixels the stamp reaches before the center's pixel
+        int size = 0;       // the stamp is size x size pixels
+        int stride = 0;     // size rounded up to a multiple of 8
+        std::vector<unsigned char> alphas;  // [offsetY][offsetX][size * stride]
+
+        DotStamps(float radius)
+        {
+            padding = int(radius) + 3;
+            size = padding * 2 + 2;
+            stride = (size + 7) & ~7;
+            alphas.resize(c_subpixelSteps * c_subpixelSteps * size * stride, 0);
+
+            for (int offsetY = 0; offsetY < c_subpixelSteps; ++offsetY)
+            {
+                for (int offsetX = 0; offsetX < c_subpixelSteps; ++offsetX)
+                {
+                    Vec2 center = Vec2{ float(padding) + float(offsetX) / float(c_subpixelSteps), float(padding) + float(offsetY) / float(c_subpixelSteps) };
+                    unsigned char* stamp = Stamp(offsetX, offsetY);
+                    for (int iy = 0; iy < size; ++iy)
+                    {
+                        for (int ix = 0; ix < size; ++ix)
+                        {
+                            float distanceToSurface = Distance(center, Vec2{ float(ix), float(iy) }) - radius;
+                            float alpha = 1.0f - SmoothStep(0.0f, 2.0f, distanceToSurface);
+                            stamp[iy * stride + ix] = (unsigned char)(alpha * 255.0f + 0.5f);
+                        }
+                    }
+                }
+            }
+        }
+
+        unsigned char* Stamp(int offsetX, int offsetY)
+        {
+            return &alphas[(offsetY * c_subpixelSteps + offsetX) * size * stride];
+        }
+
+        const unsigned char* Stamp(int offsetX, int offsetY) const
+        {
+            return &alphas[(offsetY * c_subpixelSteps + offsetX) * size * stride];
+        }
+    };
+
+    // Adds an anti aliased dot centered at (x, y) in pixels to a coverage layer, only touching pixels in
+    // [clipMinX, clipMaxX) x [clipMinY, clipMaxY). Pixel centers are at whole numbers.
+    inline void DrawDot(unsigned char* coverage, int imageSize, float x, float y, const DotStamps& stamps, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY)
+    {
+        // the pixel the stamp starts at, and which sub pixel offset of the center to use
+        int subpixelX = int(std::floor(x * float(DotStamps::c_subpixelSteps) + 0.5f));
+        int subpixelY = int(std::floor(y * float(DotStamps::c_subpixelSteps) + 0.5f));
+        int startX = (subpixelX >> 2) - stamps.padding;
+        int startY = (subpixelY >> 2) - stamps.padding;
+        const unsigned char* stamp = stamps.Stamp(subpixelX & 3, subpixelY & 3);
+        static_assert(DotStamps::c_subpixelSteps == 4, "The shifts and masks above are for 4 sub pixel steps");
+
+        int minX = std::max(startX, clipMinX);
+        int maxX = std::min(startX + stamps.size, clipMaxX);
+        int minY = std::max(startY, clipMinY);
+        int maxY = std::min(startY + stamps.size, clipMaxY);
+        if (minX >= maxX || minY >= maxY)
+            return;
+
+        // whole padded rows can be blended at once if they are inside the clip rectangle
+        bool wholeRows = startX >= clipMinX && startX + stamps.stride <= clipMaxX;
+
+        for (int py = minY; py < maxY; ++py)
+        {
+            unsigned char* row = &coverage[py * imageSize];
+            const unsigned char* stampRow = &stamp[(py - startY) * stamps.stride];
+            if (wholeRows)
+            {
+#if defined(__AVX2__)
+                const __m128i c_255 = _mm_set1_epi16(255);
+                const __m128i c_128 = _mm_set1_epi16(128);
+                for (int px = startX; px < startX + stamps.stride; px += 8)
+                {
+                    __m128i pixel = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)&row[px]));
+                    __m128i alpha = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)&stampRow[px - startX]));
+                    __m128i product = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(c_255, pixel), alpha), c_128);
+                    __m128i added = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+                    _mm_storel_epi64((__m128i*)&row[px], _mm_packus_epi16(_mm_add_epi16(pixel, added), added));
+                }
+                continue;
+#endif
+            }
+
+            for (int px = minX; px < maxX; ++px)
+                row[px] = (unsigned char)(row[px] + MulDiv255(255 - row[px], stampRow[px - startX]));
+        }
+    }
+
+    static const int c_tilesPerSide = 16;
+
+    // The largest image size that is drawn without tiles when there is only one thread. Drawing without tiles on one
+    // thread is 4x faster at 256 x 256, and about the same at 1024 x 1024. At 2048 x 2048 and up, tiles are faster
+    // even on one thread.
+    static const int c_maxUntiledSize = 1024;
+
+    // a / b, rounded down
+    inline int FloorDiv(int a, int b)
+    {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    // Draws the layers of every class. Coverage is only needed for color images, and hits for black and white.
+    inline Layers DrawLayers(const std::vector<Point>& points, int classCount, int imageSize, float dotSize, bool drawCoverage, bool drawHits)
+    {
+        Layers layers;
+        layers.imageSize = imageSize;
+        layers.classCount = classCount;
+        if (drawCoverage)
+            layers.coverage.resize(classCount, std::vector<unsigned char>(imageSize * imageSize, 0));
+        if (drawHits)
+            layers.hits.resize(classCount, std::vector<unsigned char>(imageSize * imageSize, 0));
+
+        if (drawHits)
+        {
+            for (const Point& p : points)
+            {
+                int x, y;
+                PointPixel(p, imageSize, x, y);
+                layers.hits[p.classIndex][y * imageSize + x] = 1;
+            }
+        }
+
+        if (!drawCoverage)
+            return layers;
+
+        DotStamps stamps(dotSize);
+
+        // With one thread, binning the points into tiles costs more than it saves, unless the layers are too big for the
+        // cache, where drawing a tile at a time keeps the writes in it. Otherwise each dot is drawn straight into its
+        // layer, along with a copy moved over by the image size for each edge that it crosses.
+        if (GetThreadPool().ThreadCount() == 1 && imageSize <= c_maxUntiledSize)
+        {
+            for (const Point& p : points)
+            {
+                float x = p.v[0] * float(imageSize) - 0.5f;
+                float y = p.v[1] * float(imageSize) - 0.5f;
+                int pixelX = int(std::floor(p.v[0] * float(imageSize)));
+                int pixelY = int(std::floor(p.v[1] * float(imageSize)));
+
+                float offsetsX[3] = { 0.0f };
+                float offsetsY[3] = { 0.0f };
+                int offsetCountX = 1;
+                int offsetCountY = 1;
+                if (pixelX - stamps.padding - 1 < 0)
+                    offsetsX[offsetCountX++] = float(imageSize);
+                if (pixelX + stamps.padding + 1 >= imageSize)
+                    offsetsX[offsetCountX++] = -float(imageSize);
+                if (pixelY - stamps.padding - 1 < 0)
+                    offsetsY[offsetCountY++] = float(imageSize);
+                if (pixelY + stamps.padding + 1 >= imageSize)
+                    offsetsY[offsetCountY++] = -float(imageSize);
+
+                for (int iy = 0; iy < offsetCountY; ++iy)
+                {
+                    for (int ix = 0; ix < offsetCountX; ++ix)
+                        DrawDot(layers.coverage[p.classIndex].data(), imageSize, x + offsetsX[ix], y + offsetsY[iy], stamps, 0, 0, imageSize, imageSize);
+                }
+            }
+            return layers;
+        }
+
+        // Bin each point into every tile that its dot reaches, which is usually just one
+        auto TileOfPixel = [imageSize](int pixel)
+        {
+            return FloorDiv(c_tilesPerSide * (pixel + 1) - 1, imageSize);
+        };
+        Grid<c_tilesPerSide, c_tilesPerSide> grid;
+        for (int i = 0; i < (int)points.size(); ++i)
+        {
+            int x = int(std::floor(points[i].v[0] * float(imageSize)));
+            int y = int(std::floor(points[i].v[1] * float(imageSize)));
+            int minTileX = TileOfPixel(x - stamps.padding - 1);
+            int maxTileX = std::min(TileOfPixel(x + stamps.padding + 1), minTileX + c_tilesPerSide - 1);
+            int minTileY = TileOfPixel(y - stamps.padding - 1);
+            int maxTileY = std::min(TileOfPixel(y + stamps.padding + 1), minTileY + c_tilesPerSide - 1);
+            for (int tileY = minTileY; tileY <= maxTileY; ++tileY)
+            {
+                int cellY = (tileY + c_tilesPerSide) % c_tilesPerSide;
+                for (int tileX = minTileX; tileX <= maxTileX; ++tileX)
+                {
+                    int cellX = (tileX + c_tilesPerSide) % c_tilesPerSide;
+                    grid.AddPoint(i, (float(cellX) + 0.5f) / float(c_tilesPerSide), (float(cellY) + 0.5f) / float(c_tilesPerSide));
+                }
+            }
+        }
+
+        GetThreadPool().ParallelFor(c_tilesPerSide * c_tilesPerSide,
+            [&](int tileIndex, int threadIndex)
+            {
+                int tileX = tileIndex % c_tilesPerSide;
+                int tileY = tileIndex / c_tilesPerSide;
+                int clipMinX = tileX * imageSize / c_tilesPerSide;
+                int clipMaxX = (tileX + 1) * imageSize / c_tilesPerSide;
+                int clipMinY = tileY * imageSize / c_tilesPerSide;
+                int clipMaxY = (tileY + 1) * imageSize / c_tilesPerSide;
+
+                // a dot that wrapped around an edge to get here is moved over by the image size, to be near the tile
+                float centerX = float(clipMinX + clipMaxX) * 0.5f;
+                float centerY = float(clipMinY + clipMaxY) * 0.5f;
+                auto NearTile = [imageSize](float f, float center)
+                {
+                    if (f - center > float(imageSize) * 0.5f)
+                        return f - float(imageSize);
+                    if (center - f > float(imageSize) * 0.5f)
+                        return f + float(imageSize);
+                    return f;
+                };
+
+                std::vector<int> tilePoints;
+                grid.GetCellPoints(tileX, tileY, tilePoints, false);
+                for (int index : tilePoints)
+                {
+                    const Point& p = points[index];
+                    float x = NearTile(p.v[0] * float(imageSize) - 0.5f, centerX);
+                    float y = NearTile(p.v[1] * float(imageSize) - 0.5f, centerY);
+                    DrawDot(layers.coverage[p.classIndex].data(), imageSize, x, y, stamps, clipMinX, clipMinY, clipMaxX, clipMaxY);
+                }
+            }
+        );
+
+        return layers;
+    }
+
+    // An RGB image of the dots of the classes whose bits are set in classMask, on white
+    inline std::vector<unsigned char> CompositeColor(const Layers& layers, int classMask)
+    {
+        int imageSize = layers.imageSize;
+        std::vector<unsigned char> ret(imageSize * imageSize * 3, 255);
+
+        GetThreadPool().ParallelFor(imageSize,
+            [&](int y, int threadIndex)
+            {
+                for (int classIndex = 0; classIndex < layers.classCount; ++classIndex)
+                {
+                    if ((classMask & (1 << classIndex)) == 0)
+                        continue;
+
+                    unsigned char RGB[3];
+                    ClassColor(classIndex, RGB);
+
+                    const unsigned char* coverage = &layers.coverage[classIndex][y * imageSize];
+                    unsigned char* pixel = &ret[y * imageSize * 3];
+                    for (int x = 0; x < imageSize; ++x, pixel += 3)
+                    {
+                        unsigned int alpha = coverage[x];
+                        for (int channel = 0; channel < 3; ++channel)
+                            pixel[channel] = (unsigned char)(MulDiv255(pixel[channel], 255 - alpha) + MulDiv255(RGB[channel], alpha));
+                    }
+                }
+            },
+            16
+        );
+
+        return ret;
+    }
+
+    // A black pixel for each point of the classes whose bits are set in classMask, on white
+    inline std::vector<unsigned char> CompositeBW(const Layers& layers, int classMask)
+    {
+        int imageSize = layers.imageSize;
+        std::vector<unsigned char> ret(imageSize * imageSize, 255);
+
+        GetThreadPool().ParallelFor(imageSize,
+            [&](int y, int threadIndex)
+            {
+                for (int classIndex = 0; classIndex < layers.classCount; ++classIndex)
+                {
+                    if ((classMask & (1 << classIndex)) == 0)
+                        continue;
+
+                    const unsigned char* hits = &layers.hits[classIndex][y * imageSize];
+                    unsigned char* pixels = &ret[y * imageSize];
+                    for (int x = 0; x < imageSize; ++x)
+                    {
+                        if (hits[x])
+                            pixels[x] = 0;
+                    }
+                }
+            },
+            16
+        );
+
+        return ret;
+    }
+};
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <chrono>
+
+#include "FFT.h"
 #include "Grid.h"
+#include "PointFile.h"
+#include "RandomSIMD.h"
+#include "ThreadPool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace Soft
 {
@@ -12,8 +22,567 @@ namespace Soft
         int targetCount = 0;
     };
 
+    enum class Scoring
+    {
+        // Sum the Gaussians of the points near each candidate, found using the grids
+        Exact,
+
+        // Look up the energy in a raster that every point splats its Gaussians into when it is added
+        Raster,
+
+        // Raster scoring, where class pairs with Gaussians too large to splat cheaply are left out of the
+        // rasters. Their energy comes from summing the points added since the last refresh, and when there are
+        // fftRefreshInterval of those, the rasters are rebuilt from all points with FFT convolutions.
+        // The cost of adding a point is then bounded, however large the Gaussians are.
+        FFT,
+    };
+
+    enum class Kernel
+    {
+        // exp() of the Gaussian exponent, calculated for each point
+        Exact,
+
+        // A float polynomial exp, 8 at a time with AVX2, using a precomputed -1/(2 sigma^2) for each class pair.
+        // FastExpMaxError() measures the error of each Gaussian as 1.7e-7 at most. The results differ slightly from
+        // Exact, so this has to be asked for.
+        Fast,
+    };
+
+    enum class CandidatePolicy
+    {
+        // candidateMultiplier candidates for each point already placed, which makes late points expensive
+        Multiplier,
+
+        // candidateBudget candidates for every point
+        Fixed,
+
+        // candidateBudget candidates for every doubling of the number of points placed
+        Log,
+    };
+
+    struct Settings
+    {
+        CandidatePolicy candidatePolicy = CandidatePolicy::Multiplier;
+        int candidateMultiplier = 5;
+        int candidateBudget = 32;
+
+        // This percent of the candidates are placed in the voids: the voidCellPercent of grid cells that are
+        // furthest from the points which affect the class being placed, relative to the r matrix. The rest are
+        // placed anywhere.
+        int voidCandidatePercent = 0;
+        int voidCellPercent = 5;
+
+        // Score candidates on the thread pool. Candidates are made up front and ties go to the
+        // earliest candidate, so the results are identical to single threaded.
+        bool multithreaded = true;
+
+        Scoring scoring = Scoring::Exact;
+
+        // How Gaussians are evaluated, for scoring and for raster splats
+        Kernel kernel = Kernel::Exact;
+
+        // Raster and FFT scoring: the width and height of the energy rasters.
+        // 0 means choose one where texels are half the size of the smallest sigma.
+        // FFT scoring rounds this up to a power of 2.
+        int rasterResolution = 0;
+
+        // Raster and FFT scoring: also calculate the exact score of each chosen candidate, and report the error
+        bool measureRasterError = false;
+
+        // FFT scoring: how many points that weren't fully splatted are allowed before rebuilding the rasters
+        int fftRefreshInterval = 64;
+
+        // FFT scoring: class pairs with a 3 sigma radius up to this many texels are splatted
+        int fftSplatRadius = 16;
+    };
+
+    // exp(x) for x <= 0, as 2^n * exp(r) with r in [-ln(2)/2, ln(2)/2], and exp(r) from its Taylor series
+    // up to r^6. The series is truncated well below float precision, and the measured error over the
+    // range used by 3 sigma Gaussians, [-4.5, 0], is under 2e-7, which is mostly float rounding.
+    inline float FastExp(float x)
+    {
+        // x is negative, so truncating rounds to the nearest integer
+        x = std::max(x, -87.0f);
+        int ni = int(x * 1.44269504f - 0.5f);
+        float n = float(ni);
+
+        // ln(2) in two parts, so that r is accurate
+        float r = x - n * 0.693359375f;
+        r = r + n * 2.12194440e-4f;
+
+        float p = 1.0f / 720.0f;
+        p = p * r + 1.0f / 120.0f;
+        p = p * r + 1.0f / 24.0f;
+        p = p * r + 1.0f / 6.0f;
+        p = p * r + 0.5f;
+        p = p * r + 1.0f;
+        p = p * r + 1.0f;
+
+        // 2^n, made by putting n in the exponent bits
+        uint32_t bits = uint32_t(ni + 127) << 23;
+        float scale;
+        memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+#if defined(__AVX2__)
+    // FastExp() on 8 values at once
+    inline __m256 FastExp8(__m256 x)
+    {
+        x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+        __m256i ni = _mm256_cvttps_epi32(_mm256_sub_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _mm256_set1_ps(0.5f)));
+        __m256 n = _mm256_cvtepi32_ps(ni);
+
+        __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(0.693359375f)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(2.12194440e-4f)));
+
+        __m256 p = _mm256_set1_ps(1.0f / 720.0f);
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.0f / 120.0f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.0f / 24.0f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.0f / 6.0f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(0.5f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.0f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(1.0f));
+
+        __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(ni, _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+    }
+#endif
+
+    // The sum of exp(distSq * scale) over the distances, where scale is -1/(2 sigma^2)
+    inline float SumFastGaussians(const float* distSqs, int count, float scale)
+    {
+        int i = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        __m256 scale8 = _mm256_set1_ps(scale);
+        __m256 sum8 = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+            sum8 = _mm256_add_ps(sum8, FastExp8(_mm256_mul_ps(_mm256_loadu_ps(&distSqs[i]), scale8)));
+
+        alignas(32) float sums[8];
+        _mm256_store_ps(sums, sum8);
+        for (float f : sums)
+            sum += f;
+#endif
+        for (; i < count; ++i)
+            sum += FastExp(distSqs[i] * scale);
+        return sum;
+    }
+
+    // The largest absolute error of FastExp() over the range that 3 sigma truncated Gaussians use,
+    // measured against double precision exp(). This is slow, and is for CompareSoftKernels() in main.cpp.
+    inline float FastExpMaxError()
+    {
+        static const int c_steps = 1 << 20;
+        double maxError = 0.0;
+        for (int i = 0; i <= c_steps; ++i)
+        {
+            float x = -4.5f * float(i) / float(c_steps);
+            maxError = std::max(maxError, std::abs(double(FastExp(x)) - std::exp(double(x))));
+        }
+        return float(maxError);
+    }
+
+    // The number of candidates to make for the next point
+    inline int CandidateCount(const Settings& settings, int pointCount)
+    {
+        switch (settings.candidatePolicy)
+        {
+            case CandidatePolicy::Fixed: return std::max(settings.candidateBudget, 1);
+            case CandidatePolicy::Log: return std::max(int(std::ceil(float(settings.candidateBudget) * std::log2(float(pointCount + 2)))), 1);
+            default: return pointCount * settings.candidateMultiplier + 1;
+        }
+    }
+
+    // The cells of a 100x100 grid, like the one Soft uses, ranked by how far their centers are from the nearest point
+    // that affects a class. Distances are in units of the r matrix radius between the classes, and are capped at
+    // c_maxDistance radii, since nothing is affected further out than that. Cells are kept in buckets of distance, with
+    // a cell moved to its new bucket by swapping it with the last cell of its old one, so adding a point is O(1) per
+    // nearby cell. The void candidates come from the highest buckets, which are the cells furthest from any point.
+    class VoidCells
+    {
+    public:
+        static const int c_cellsPerAxis = 100;
+        static const int c_bucketCount = 64;
+        static constexpr float c_maxDistance = 2.0f;
+
+        VoidCells()
+        {
+            // every cell starts out as far from the points as can be
+            int cellCount = c_cellsPerAxis * c_cellsPerAxis;
+            m_distances.resize(cellCount, c_maxDistance);
+            m_cellBuckets.resize(cellCount, c_bucketCount - 1);
+            m_positions.resize(cellCount);
+            m_buckets.resize(c_bucketCount);
+            for (int i = 0; i < cellCount; ++i)
+            {
+                m_positions[i] = i;
+                m_buckets[c_bucketCount - 1].push_back(i);
+            }
+        }
+
+        // A point that affects this class with the given r matrix radius was added
+        void AddPoint(float x, float y, float radius, bool toroidal)
+        {
+            if (radius <= 0.0f)
+                return;
+
+            int cellX = Grid<c_cellsPerAxis, c_cellsPerAxis>::XToCellX(x);
+            int cellY = Grid<c_cellsPerAxis, c_cellsPerAxis>::YToCellY(y);
+            int window = int(std::ceil(c_maxDistance * radius * float(c_cellsPerAxis))) + 1;
+            window = std::min(window, c_cellsPerAxis / 2);
+            for (int iy = cellY - window; iy <= cellY + window; ++iy)
+            {
+                int wrappedY = (iy + c_cellsPerAxis) % c_cellsPerAxis;
+                if (!toroidal && wrappedY != iy)
+                    continue;
+
+                for (int ix = cellX - window; ix <= cellX + window; ++ix)
+                {
+                    int wrappedX = (ix + c_cellsPerAxis) % c_cellsPerAxis;
+                    if (!toroidal && wrappedX != ix)
+                        continue;
+
+                    // the unwrapped cell center, so the distance is the toroidal one when the cell wrapped
+                    float dx = (float(ix) + 0.5f) / float(c_cellsPerAxis) - x;
+                    float dy = (float(iy) + 0.5f) / float(c_cellsPerAxis) - y;
+                    float distance = std::sqrt(dx * dx + dy * dy) / radius;
+
+                    int cell = wrappedY * c_cellsPerAxis + wrappedX;
+                    if (distance < m_distances[cell])
+                    {
+                        m_distances[cell] = distance;
+                        MoveToBucket(cell, std::min(int(distance * float(c_bucketCount) / c_maxDistance), c_bucketCount - 1));
+                    }
+                }
+            }
+        }
+
+        // A point in one of the cells furthest from the points, from two random numbers for choosing the cell, and two
+        // for the position in it. Whole buckets are taken from the top until they hold at least percent of the cells.
+        Vec2 Sample(const Vec2& cellChoice, const Vec2& offset, int percent) const
+        {
+            int wanted = std::max(c_cellsPerAxis * c_cellsPerAxis * percent / 100, 1);
+            int count = 0;
+            for (int bucket = c_bucketCount - 1; bucket >= 0 && count < wanted; --bucket)
+                count += (int)m_buckets[bucket].size();
+
+            int index = std::min(int(cellChoice[0] * float(count)), count - 1);
+            int bucket = c_bucketCount - 1;
+            while (index >= (int)m_buckets[bucket].size())
+            {
+                index -= (int)m_buckets[bucket].size();
+                bucket--;
+            }
+            int cell = m_buckets[bucket][index];
+
+            return Vec2
+            {
+                std::min((float(cell % c_cellsPerAxis) + offset[0]) / float(c_cellsPerAxis), 0.99999994f),
+                std::min((float(cell / c_cellsPerAxis) + offset[1]) / float(c_cellsPerAxis), 0.99999994f)
+            };
+        }
+
+    private:
+        void MoveToBucket(int cell, int bucket)
+        {
+            int oldBucket = m_cellBuckets[cell];
+            if (bucket == oldBucket)
+                return;
+
+            std::vector<int>& oldCells = m_buckets[oldBucket];
+            int position = m_positions[cell];
+            int lastCell = oldCells.back();
+            oldCells[position] = lastCell;
+            m_positions[lastCell] = position;
+            oldCells.pop_back();
+
+            m_positions[cell] = (int)m_buckets[bucket].size();
+            m_buckets[bucket].push_back(cell);
+            m_cellBuckets[cell] = bucket;
+        }
+
+        std::vector<float> m_distances;
+        std::vector<int> m_cellBuckets;
+        std::vector<int> m_positions;
+        std::vector<std::vector<int>> m_buckets;
+    };
+
+    // An energy raster per class. When a point of class j is added, its Gaussian with sigma = 0.25 * rMatrix[c][j]
+    // is splatted into the raster of each class c, so scoring a candidate of class c is a bilinear lookup.
+    // Splats are truncated at 3 sigma, like exact scoring is.
+    //
+    // Bilinear interpolation of a function f is off by at most h^2/8 * (max|f_xx| + max|f_yy|), for texel size h.
+    // A Gaussian's second derivative is largest at its center, at 1/sigma^2, which makes the error of each
+    // splatted Gaussian at most h^2 / (4 sigma^2). The error of a score is at most that times the number of
+    // points within 3 sigma.
+    template <size_t N>
+    class EnergyRaster
+    {
+    public:
+        void Init(int resolution, bool toroidal)
+        {
+            m_resolution = resolution;
+            m_toroidal = toroidal;
+            for (std::vector<float>& energy : m_energy)
+                energy.assign(resolution * resolution, 0.0f);
+        }
+
+        int Resolution() const
+        {
+            return m_resolution;
+        }
+
+        static float KernelErrorBound(int resolution, float sigma)
+        {
+            float h = 1.0f / float(resolution);
+            return h * h / (4.0f * sigma * sigma);
+        }
+
+        void Splat(int classIndex, float x, float y, float sigma, Kernel kernel)
+        {
+            std::vector<float>& energy = m_energy[classIndex];
+
+            float radius = 3.0f * sigma;
+            float scale = -1.0f / (2.0f * sigma * sigma);
+            int minX = int(std::floor((x - radius) * float(m_resolution) - 0.5f));
+            int maxX = int(std::ceil((x + radius) * float(m_resolution) - 0.5f));
+            int minY = int(std::floor((y - radius) * float(m_resolution) - 0.5f));
+            int maxY = int(std::ceil((y + radius) * float(m_resolution) - 0.5f));
+
+            if (!m_toroidal)
+            {
+                minX = std::max(minX, 0);
+                maxX = std::min(maxX, m_resolution - 1);
+                minY = std::max(minY, 0);
+                maxY = std::min(maxY, m_resolution - 1);
+            }
+
+            for (int iy = minY; iy <= maxY; ++iy)
+            {
+                int texelY = (iy % m_resolution + m_resolution) % m_resolution;
+                float dy = (float(iy) + 0.5f) / float(m_resolution) - y;
+                for (int ix = minX; ix <= maxX; ++ix)
+                {
+                    int texelX = (ix % m_resolution + m_resolution) % m_resolution;
+                    float dx = (float(ix) + 0.5f) / float(m_resolution) - x;
+                    float distSq = dx * dx + dy * dy;
+                    if (distSq >= radius * radius)
+                        continue;
+                    if (kernel == Kernel::Fast)
+                        energy[texelY * m_resolution + texelX] += FastExp(distSq * scale);
+                    else
+                        energy[texelY * m_resolution + texelX] += exp(-(distSq) / (2.0f * sigma * sigma));
+                }
+            }
+        }
+
+        float Sample(int classIndex, float x, float y) const
+        {
+            const std::vector<float>& energy = m_energy[classIndex];
+
+            // texel centers are at (i + 0.5) / resolution
+            float u = x * float(m_resolution) - 0.5f;
+            float v = y * float(m_resolution) - 0.5f;
+            int x0 = int(std::floor(u));
+            int y0 = int(std::floor(v));
+            float fractX = u - float(x0);
+            float fractY = v - float(y0);
+            int x1 = x0 + 1;
+            int y1 = y0 + 1;
+
+            if (m_toroidal)
+            {
+                x0 = (x0 + m_resolution) % m_resolution;
+                x1 = x1 % m_resolution;
+                y0 = (y0 + m_resolution) % m_resolution;
+                y1 = y1 % m_resolution;
+            }
+            else
+            {
+                x0 = std::max(x0, 0);
+                x1 = std::min(x1, m_resolution - 1);
+                y0 = std::max(y0, 0);
+                y1 = std::min(y1, m_resolution - 1);
+            }
+
+            float e00 = energy[y0 * m_resolution + x0];
+            float e01 = energy[y0 * m_resolution + x1];
+            float e10 = energy[y1 * m_resolution + x0];
+            float e11 = energy[y1 * m_resolution + x1];
+            return Lerp(Lerp(e00, e01, fractX), Lerp(e10, e11, fractX), fractY);
+        }
+
+        // Recalculates every raster from scratch, as the sum of the full, untruncated Gaussians of the points.
+        // The points of each class are put into a density raster with bilinear weights, which is convolved with
+        // the Gaussian of each class pair using FFTs. The rasters need to be a power of 2 in size.
+        // Rasters that aren't toroidal are padded to twice the size, so that the convolution doesn't wrap around.
+        // Densities and energies are real, so two of them are packed into each complex FFT, as the real and
+        // imaginary parts.
+        void RebuildWithFFT(const std::vector<Point>& points, const std::array<std::array<float, N>, N>& sigmas)
+        {
+            int size = m_toroidal ? m_resolution : m_resolution * 2;
+            int sizeSq = size * size;
+            if (m_fft.Width() != size)
+            {
+                m_fft.Init(size, size);
+                m_fft1D.Init(size);
+            }
+
+            // A sampled 2D Gaussian is the product of two sampled 1D Gaussians, so its DFT is too.
+            // The 1D Gaussians are symmetric, so their DFTs are real.
+            std::vector<FFT::Complex> gaussian(size);
+            for (int c = 0; c < N; ++c)
+            {
+                for (int j = 0; j < N; ++j)
+                {
+                    float sigma = sigmas[c][j];
+                    for (int i = 0; i < size; ++i)
+                    {
+                        float distance = float(std::min(i, size - i)) / float(m_resolution);
+                        gaussian[i] = (sigma > 0.0f) ? exp(-(distance * distance) / (2.0f * sigma * sigma)) : 0.0f;
+                    }
+                    m_fft1D.Transform(gaussian.data(), false);
+                    m_kernelSpectra[c][j].resize(size);
+                    for (int i = 0; i < size; ++i)
+                        m_kernelSpectra[c][j][i] = gaussian[i].real();
+                }
+            }
+
+            // the density raster of each class, class a + 1 in the imaginary part of class a's
+            for (int a = 0; a < N; a += 2)
+                m_densities[a].assign(sizeSq, FFT::Complex(0.0f, 0.0f));
+            for (const Point& p : points)
+            {
+                FFT::Complex* density = m_densities[p.classIndex & ~1].data();
+                float u = p.v[0] * float(m_resolution) - 0.5f;
+                float v = p.v[1] * float(m_resolution) - 0.5f;
+                int x0 = int(std::floor(u));
+                int y0 = int(std::floor(v));
+                float fractX = u - float(x0);
+                float fractY = v - float(y0);
+                int x1 = (x0 + 1) % size;
+                int y1 = (y0 + 1) % size;
+                x0 = (x0 + size) % size;
+                y0 = (y0 + size) % size;
+
+                FFT::Complex unit = (p.classIndex & 1) ? FFT::Complex(0.0f, 1.0f) : FFT::Complex(1.0f, 0.0f);
+                density[y0 * size + x0] += unit * ((1.0f - fractX) * (1.0f - fractY));
+                density[y0 * size + x1] += unit * (fractX * (1.0f - fractY));
+                density[y1 * size + x0] += unit * ((1.0f - fractX) * fractY);
+                density[y1 * size + x1] += unit * (fractX * fractY);
+            }
+
+            // transform, and unpack using the symmetry of real signals' DFTs: A[k] = conj(A[-k])
+            for (int a = 0; a < N; a += 2)
+            {
+                m_fft.Transform(m_densities[a], false);
+                if (a + 1 >= N)
+                    break;
+
+                m_scratch = m_densities[a];
+                m_densities[a + 1].resize(sizeSq);
+                for (int y = 0; y < size; ++y)
+                {
+                    int negY = (size - y) % size;
+                    for (int x = 0; x < size; ++x)
+                    {
+                        int negX = (size - x) % size;
+                        FFT::Complex z = m_scratch[y * size + x];
+                        FFT::Complex zNegConj = std::conj(m_scratch[negY * size + negX]);
+                        FFT::Complex sum = (z + zNegConj) * 0.5f;
+                        FFT::Complex difference = (z - zNegConj) * 0.5f;
+                        m_densities[a][y * size + x] = sum;
+                        m_densities[a + 1][y * size + x] = FFT::Complex(difference.imag(), -difference.real());
+                    }
+                }
+            }
+
+            // the energies of class c and c + 1 go in the real and imaginary parts of one inverse FFT
+            for (int c = 0; c < N; c += 2)
+            {
+                std::vector<FFT::Complex>& energy = m_scratch;
+                energy.assign(sizeSq, FFT::Complex(0.0f, 0.0f));
+                for (int j = 0; j < N; ++j)
+                {
+                    const FFT::Complex* density = m_densities[j].data();
+                    const float* spectrum = m_kernelSpectra[c][j].data();
+                    const float* spectrumNext = m_kernelSpectra[std::min(c + 1, (int)N - 1)][j].data();
+                    float nextScale = (c + 1 < N) ? 1.0f : 0.0f;
+                    for (int y = 0; y < size; ++y)
+                    {
+                        for (int x = 0; x < size; ++x)
+                        {
+                            FFT::Complex d = density[y * size + x];
+                            float k = spectrum[x] * spectrum[y];
+                            float kNext = spectrumNext[x] * spectrumNext[y] * nextScale;
+                            energy[y * size + x] += FFT::Complex(d.real() * k - d.imag() * kNext, d.imag() * k + d.real() * kNext);
+                        }
+                    }
+                }
+                m_fft.Transform(energy, true);
+
+                for (int y = 0; y < m_resolution; ++y)
+                {
+                    for (int x = 0; x < m_resolution; ++x)
+                    {
+                        m_energy[c][y * m_resolution + x] = energy[y * size + x].real();
+                        if (c + 1 < N)
+                            m_energy[c + 1][y * m_resolution + x] = energy[y * size + x].imag();
+                    }
+                }
+            }
+        }
+
+    private:
+        int m_resolution = 0;
+        bool m_toroidal = true;
+        std::array<std::vector<float>, N> m_energy;
+
+        // for RebuildWithFFT
+        FFT::Plan2D m_fft;
+        FFT::Plan m_fft1D;
+        std::array<std::vector<FFT::Complex>, N> m_densities;
+        std::array<std::array<std::vector<float>, N>, N> m_kernelSpectra;
+        std::vector<FFT::Complex> m_scratch;
+    };
+
+    // A candidate's score is the sum of the Gaussian energies from existing points within 3 sigma.
+    // scales are -1/(2 sigma^2), which only the fast kernel uses.
+    template <size_t N, bool TOROIDAL>
+    float ScoreCandidate(const Vec2& candidate, const std::vector<Grid<100, 100>>& grids, const std::array<float, N>& sigmas, const std::array<float, N>& scales, Kernel kernel, std::vector<float>& distances, std::array<int, N + 1>& classStarts)
+    {
+        // gather the squared distances for all classes into one array
+        distances.clear();
+        for (int classIndex = 0; classIndex < N; ++classIndex)
+        {
+            classStarts[classIndex] = (int)distances.size();
+            grids[classIndex].GetPointDistancesSq<TOROIDAL>(candidate[0], candidate[1], 3.0f * sigmas[classIndex], distances, true);
+        }
+        classStarts[N] = (int)distances.size();
+
+        // then sum the energies over each contiguous run
+        float score = 0.0f;
+        for (int classIndex = 0; classIndex < N; ++classIndex)
+        {
+            if (kernel == Kernel::Fast)
+            {
+                score += SumFastGaussians(&distances[classStarts[classIndex]], classStarts[classIndex + 1] - classStarts[classIndex], scales[classIndex]);
+                continue;
+            }
+
+            float sigma = sigmas[classIndex];
+            const float* distSqs = distances.data();
+            for (int i = classStarts[classIndex]; i < classStarts[classIndex + 1]; ++i)
+                score += exp(-(distSqs[i]) / (2.0f * sigma * sigma));
+        }
+        return score;
+    }
+
+    // If info is given, it gets the r matrix and the parameters, to save with the points
     template <size_t N, typename RNG>
-    std::vector<Point> Make(const int(&counts)[N], RNG& rng, bool toroidal, int candidateMultiplier = 5)
+    std::vector<Point> Make(const int(&counts)[N], RNG& rng, bool toroidal, const Settings& settings, PointFile::Info* info = nullptr)
     {
         std::vector<Grid<100, 100>> grids(N);
 
@@ -71,10 +640,85 @@ namespace Soft
             }
         }
 
+        // The sigma of each class pair, and the -1/(2 sigma^2) that the fast kernel multiplies by
+        std::array<std::array<float, N>, N> sigmaMatrix;
+        std::array<std::array<float, N>, N> scaleMatrix;
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+            {
+                sigmaMatrix[i][j] = 0.25f * rMatrix[i][j];
+                scaleMatrix[i][j] = -1.0f / (2.0f * sigmaMatrix[i][j] * sigmaMatrix[i][j]);
+            }
+        }
+
+        // Set up raster scoring
+        bool useRaster = settings.scoring != Scoring::Exact;
+        EnergyRaster<N> energyRaster;
+        double rasterErrorSum = 0.0;
+        float rasterErrorMax = 0.0f;
+        float rasterErrorBound = 0.0f;
+        int fftRefreshCount = 0;
+        double fftRefreshSeconds = 0.0;
+        std::array<std::array<bool, N>, N> splatPair;
+        std::vector<Point> unsplattedPoints;
+        if (useRaster)
+        {
+            float minSigma = FLT_MAX;
+            for (int i = 0; i < N; ++i)
+            {
+                for (int j = 0; j < N; ++j)
+                {
+                    if (rMatrix[i][j] > 0.0f)
+                        minSigma = std::min(minSigma, 0.25f * rMatrix[i][j]);
+                }
+            }
+
+            int resolution = settings.rasterResolution;
+            if (resolution <= 0)
+            {
+                resolution = 1;
+                while (1.0f / float(resolution) > minSigma / 2.0f)
+                    resolution *= 2;
+            }
+            if (settings.scoring == Scoring::FFT)
+            {
+                int powerOf2 = 1;
+                while (powerOf2 < resolution)
+                    powerOf2 *= 2;
+                resolution = powerOf2;
+            }
+            energyRaster.Init(resolution, toroidal);
+
+            // which class pairs are splatted when a point is added
+            for (int i = 0; i < N; ++i)
+            {
+                for (int j = 0; j < N; ++j)
+                    splatPair[i][j] = settings.scoring != Scoring::FFT || 3.0f * sigmaMatrix[i][j] * float(resolution) <= float(settings.fftSplatRadius);
+            }
+            rasterErrorBound = EnergyRaster<N>::KernelErrorBound(resolution, minSigma);
+        }
+
         // Make the points!
         std::vector<Point> ret;
         {
-            std::vector<float> distances; // out here to avoid allocs
+            ThreadPool& threadPool = GetThreadPool();
+            int threadCount = settings.multithreaded ? threadPool.ThreadCount() : 1;
+
+            // out here to avoid allocs
+            std::vector<Vec2> candidates;
+            std::vector<float> candidateXs, candidateYs;
+            std::vector<VoidCells> voidCells(N);
+            std::vector<std::vector<float>> threadDistances(threadCount);
+            std::vector<std::array<int, N + 1>> threadClassStarts(threadCount);
+
+            struct Best
+            {
+                float score = FLT_MAX;
+                int index = -1;
+            };
+            std::vector<Best> batchBests;
+
             int lastPercent = -1;
             for (int pointIndex = 0; pointIndex < totalCount; ++pointIndex)
             {
@@ -98,43 +742,152 @@ namespace Soft
                     }
                 }
 
-                Vec2 bestCandidate;
-                float bestScore = FLT_MAX;
+                const std::array<float, N>& sigmas = sigmaMatrix[leastPercentClass];
+                const std::array<float, N>& scales = scaleMatrix[leastPercentClass];
 
-                int candidateCount = int(ret.size()) * candidateMultiplier + 1;
-                for (int i = 0; i < candidateCount; ++i)
+                // make the candidates serially, so the RNG is used in the same order no matter how many threads there are
+                int candidateCount = CandidateCount(settings, (int)ret.size());
+                int voidCandidateCount = candidateCount * settings.voidCandidatePercent / 100;
+                candidates.resize(candidateCount);
+                for (int i = 0; i < voidCandidateCount; ++i)
                 {
-                    Vec2 candidate = rng();
+                    Vec2 cellChoice = rng();
+                    candidates[i] = voidCells[leastPercentClass].Sample(cellChoice, rng(), settings.voidCellPercent);
+                }
+                FillCandidates(rng, candidates.data() + voidCandidateCount, candidateCount - voidCandidateCount, candidateXs, candidateYs);
 
-                    // Get points within 3 sigmas
-                    float score = 0.0f;
-                    for (int classIndex = 0; classIndex < N; ++classIndex)
+                // score batches of candidates in parallel, keeping the best of each batch.
+                // Ties go to the lower index, which is what a serial loop keeping the first best would do.
+                static const int c_batchSize = 64;
+                int batchCount = (candidateCount + c_batchSize - 1) / c_batchSize;
+                batchBests.assign(batchCount, Best());
+                auto ScoreBatch = [&](int batchIndex, int threadIndex)
+                {
+                    Best best;
+                    int begin = batchIndex * c_batchSize;
+                    int end = std::min(begin + c_batchSize, candidateCount);
+                    for (int i = begin; i < end; ++i)
                     {
-                        float sigma = 0.25f * rMatrix[leastPercentClass][classIndex];
-                        if (toroidal)
-                            grids[classIndex].GetPointDistancesSq<true>(candidate[0], candidate[1], 3.0f * sigma, distances, false);
+                        float score;
+                        if (useRaster)
+                        {
+                            score = energyRaster.Sample(leastPercentClass, candidates[i][0], candidates[i][1]);
+                            for (const Point& p : unsplattedPoints)
+                            {
+                                if (splatPair[leastPercentClass][p.classIndex])
+                                    continue;
+                                float distSq = toroidal ? ToroidalDistanceSq(candidates[i], p.v) : DistanceSq(candidates[i], p.v);
+                                score += (settings.kernel == Kernel::Fast)
+                                    ? FastExp(distSq * scales[p.classIndex])
+                                    : exp(-(distSq) / (2.0f * sigmas[p.classIndex] * sigmas[p.classIndex]));
+                            }
+                        }
+                        else if (toroidal)
+                            score = ScoreCandidate<N, true>(candidates[i], grids, sigmas, scales, settings.kernel, threadDistances[threadIndex], threadClassStarts[threadIndex]);
                         else
-                            grids[classIndex].GetPointDistancesSq<false>(candidate[0], candidate[1], 3.0f * sigma, distances, false);
-                        for (float distSq : distances)
-                            score += exp(-(distSq) / (2.0f * sigma * sigma));
-                    }
+                            score = ScoreCandidate<N, false>(candidates[i], grids, sigmas, scales, settings.kernel, threadDistances[threadIndex], threadClassStarts[threadIndex]);
 
-                    // if this score is the best we've seen so far, take it as the new best
-                    if (score < bestScore)
-                    {
-                        bestCandidate = candidate;
-                        bestScore = score;
+                        // if this score is the best we've seen so far, take it as the new best
+                        if (score < best.score)
+                        {
+                            best.score = score;
+                            best.index = i;
+                        }
                     }
+                    batchBests[batchIndex] = best;
+                };
+
+                if (threadCount > 1)
+                    threadPool.ParallelFor(batchCount, ScoreBatch);
+                else
+                {
+                    for (int batchIndex = 0; batchIndex < batchCount; ++batchIndex)
+                        ScoreBatch(batchIndex, 0);
+                }
+
+                // batches are in candidate order, so a strict less than keeps the earliest of any ties
+                Best best;
+                for (const Best& batchBest : batchBests)
+                {
+                    if (batchBest.score < best.score)
+                        best = batchBest;
+                }
+                Vec2 bestCandidate = candidates[std::max(best.index, 0)];
+
+                if (useRaster && settings.measureRasterError)
+                {
+                    float exactScore = toroidal
+                        ? ScoreCandidate<N, true>(bestCandidate, grids, sigmas, scales, settings.kernel, threadDistances[0], threadClassStarts[0])
+                        : ScoreCandidate<N, false>(bestCandidate, grids, sigmas, scales, settings.kernel, threadDistances[0], threadClassStarts[0]);
+                    float error = std::abs(exactScore - best.score);
+                    rasterErrorSum += error;
+                    rasterErrorMax = std::max(rasterErrorMax, error);
                 }
 
                 // add the point
                 ret.push_back({ leastPercentClass, {bestCandidate} });
                 layers[leastPercentClass].sampleCount++;
                 grids[leastPercentClass].AddPoint((int)ret.size() - 1, bestCandidate[0], bestCandidate[1]);
+
+                // the cells around the point are less of a void for the classes that it affects
+                if (settings.voidCandidatePercent > 0)
+                {
+                    for (int classIndex = 0; classIndex < N; ++classIndex)
+                        voidCells[classIndex].AddPoint(bestCandidate[0], bestCandidate[1], rMatrix[classIndex][leastPercentClass], toroidal);
+                }
+
+                // splat the new point into the energy raster of every class
+                if (useRaster)
+                {
+                    bool allSplatted = true;
+                    for (int classIndex = 0; classIndex < N; ++classIndex)
+                    {
+                        if (splatPair[classIndex][leastPercentClass])
+                            energyRaster.Splat(classIndex, bestCandidate[0], bestCandidate[1], sigmaMatrix[classIndex][leastPercentClass], settings.kernel);
+                        else
+                            allSplatted = false;
+                    }
+                    if (!allSplatted)
+                        unsplattedPoints.push_back(ret.back());
+                }
+
+                // rebuild the rasters when there are too many points to sum for the pairs that aren't splatted
+                if ((int)unsplattedPoints.size() >= std::max(settings.fftRefreshInterval, 1))
+                {
+                    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                    energyRaster.RebuildWithFFT(ret, sigmaMatrix);
+                    fftRefreshSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+                    fftRefreshCount++;
+                    unsplattedPoints.clear();
+                }
             }
         }
         printf("\r100%%\n");
 
+        if (useRaster)
+        {
+            printf("Raster scoring at %i x %i, error bound %f per Gaussian\n", energyRaster.Resolution(), energyRaster.Resolution(), rasterErrorBound);
+            if (settings.scoring == Scoring::FFT)
+                printf("%i FFT refreshes, taking %0.2f seconds\n", fftRefreshCount, fftRefreshSeconds);
+            if (settings.measureRasterError)
+                printf("Error vs exact scoring: max %f, mean %f\n", rasterErrorMax, float(rasterErrorSum / double(std::max(totalCount, 1))));
+        }
+
+        if (info)
+        {
+            info->rMatrix = PointFile::UnsortRMatrix(rMatrix, layers);
+            info->params = "Soft::Make";
+            PointFile::AppendParam(info->params, "counts", counts);
+            PointFile::AppendParam(info->params, "toroidal", toroidal ? 1 : 0);
+            PointFile::AppendParam(info->params, "candidatePolicy", int(settings.candidatePolicy));
+            PointFile::AppendParam(info->params, "candidateMultiplier", settings.candidateMultiplier);
+            PointFile::AppendParam(info->params, "candidateBudget", settings.candidateBudget);
+            PointFile::AppendParam(info->params, "voidCandidatePercent", settings.voidCandidatePercent);
+            PointFile::AppendParam(info->params, "voidCellPercent", settings.voidCellPercent);
+            PointFile::AppendParam(info->params, "scoring", int(settings.scoring));
+            PointFile::AppendParam(info->params, "kernel", int(settings.kernel));
+        }
+
         // unsort the layers, so they are in the same order that the user asked for
         for (int i = 0; i < N; ++i)
         {
@@ -160,4 +913,12 @@ namespace Soft
 
         return ret;
     }
+
+    template <size_t N, typename RNG>
+    std::vector<Point> Make(const int(&counts)[N], RNG& rng, bool toroidal, int candidateMultiplier = 5, PointFile::Info* info = nullptr)
+    {
+        Settings settings;
+        settings.candidateMultiplier = candidateMultiplier;
+        return Make(counts, rng, toroidal, settings, info);
+    }
 };
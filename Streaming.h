@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+
+#include "Grid.h"
+#include "Hard.h"
+
+// Streaming multi class dart throwing, for domains too large to hold in memory.
+// The domain is tilesX by tilesY unit tiles, made one at a time in scanline order. Each tile is filled like Hard::Make,
+// using its layers, r matrix and conflict checks, against the points of the tiles already made that are close enough
+// to matter: the band along the right edge of the tile to its left, and the bands along the top edges of the three
+// tiles below it. Bands are as wide as the largest radius. As soon as a tile is made it is passed to onTile, and only
+// its bands are kept, so memory use depends on tilesX and the number of points in a tile, but not on tilesY.
+//
+// Radii are in units of tiles, and must be at most 0.5. Points that fail to fit after enough tries are skipped,
+// like Hard::Make gives up, but there is no point removal, because finished tiles can't change.
+
+namespace Streaming
+{
+    struct Stats
+    {
+        long long pointCount = 0;
+        int maxLivePoints = 0;      // the most points kept in bands at once
+    };
+
+    // onTile(tileX, tileY, points) is called for every tile, with points in [0,1)^2 of that tile, in the order that
+    // the user gave the classes.
+    template <size_t N, typename RNG, typename LAMBDA>
+    Stats Make(const float(&radii)[N], int targetCountPerTile, int tilesX, int tilesY, RNG& rng, const LAMBDA& onTile)
+    {
+        Stats stats;
+
+        std::vector<Hard::Layer> layers = Hard::MakeLayers(radii, targetCountPerTile);
+        std::array<std::array<float, N>, N> rMatrix = Hard::MakeRMatrix<N>(layers);
+
+        float band = layers[0].radius;
+        if (band > 0.5f)
+        {
+            printf("Streaming::Make(): radius %f is too large for a tile. It needs to be at most 0.5.\n", band);
+            return stats;
+        }
+
+        // A tile is made in [-0.5, 1.5) around it, which the grids see as (x + 0.5) / 2, so distances are halved
+        std::array<std::array<float, N>, N> gridRMatrix;
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+                gridRMatrix[i][j] = rMatrix[i][j] * 0.5f;
+        }
+        std::vector<Grid<100, 100>> grids(N);
+
+        // the bands of the last row and this row, in the coordinates of their own tiles, and classes of the sorted layers
+        std::vector<std::vector<Point>> lastRowTopBands(tilesX);
+        std::vector<std::vector<Point>> topBands(tilesX);
+        std::vector<Point> rightBand;
+
+        const int c_failCountFatal = targetCountPerTile * 20;
+        std::vector<Point> workPoints;
+        std::vector<Point> tilePoints;
+        std::vector<int> conflicts;
+        int lastPercent = -1;
+        for (int tileY = 0; tileY < tilesY; ++tileY)
+        {
+            std::swap(lastRowTopBands, topBands);
+            rightBand.clear();
+
+            int livePoints = 0;
+            for (const std::vector<Point>& points : lastRowTopBands)
+                livePoints += (int)points.size();
+            for (const std::vector<Point>& points : topBands)
+                livePoints += (int)points.size();
+
+            for (int tileX = 0; tileX < tilesX; ++tileX)
+            {
+                int percent = int(100.0f * float(tileY * tilesX + tileX) / float(tilesX * tilesY));
+                if (percent != lastPercent)
+                {
+                    printf("\r%i%%", percent);
+                    lastPercent = percent;
+                }
+
+                // gather the neighboring bands, moved into this tile's coordinates
+                workPoints.clear();
+                for (const Point& p : rightBand)
+                    workPoints.push_back({ p.classIndex, Vec2{ p.v[0] - 1.0f, p.v[1] } });
+                if (tileY > 0)
+                {
+                    for (int offsetX = -1; offsetX <= 1; ++offsetX)
+                    {
+                        if (tileX + offsetX < 0 || tileX + offsetX >= tilesX)
+                            continue;
+                        // only the part within a band's width of this tile matters, and the grids only go that far
+                        for (const Point& p : lastRowTopBands[tileX + offsetX])
+                        {
+                            float x = p.v[0] + float(offsetX);
+                            if (x >= -band && x < 1.0f + band)
+                                workPoints.push_back({ p.classIndex, Vec2{ x, p.v[1] - 1.0f } });
+                        }
+                    }
+                }
+
+                for (Grid<100, 100>& grid : grids)
+                    grid.Clear();
+                for (int i = 0; i < (int)workPoints.size(); ++i)
+                    grids[workPoints[i].classIndex].AddPoint(i, (workPoints[i].v[0] + 0.5f) * 0.5f, (workPoints[i].v[1] + 0.5f) * 0.5f);
+
+                // fill the tile
+                for (Hard::Layer& layer : layers)
+                    layer.sampleCount = 0;
+                tilePoints.clear();
+                int failCount = 0;
+                while (tilePoints.size() < targetCountPerTile && failCount <= c_failCountFatal)
+                {
+                    // find the class which is least filled.
+                    float leastPercent = FLT_MAX;
+                    int leastPercentClass = -1;
+                    for (int i = 0; i < N; ++i)
+                    {
+                        float percent = float(layers[i].sampleCount) / float(layers[i].targetCount);
+                        if (percent < leastPercent)
+                        {
+                            leastPercent = percent;
+                            leastPercentClass = i;
+                        }
+                    }
+
+                    Vec2 point = rng();
+                    Vec2 gridPoint = Vec2{ (point[0] + 0.5f) * 0.5f, (point[1] + 0.5f) * 0.5f };
+                    Hard::FindConflicts(gridPoint, leastPercentClass, grids, gridRMatrix, false, true, conflicts);
+                    if (conflicts.size() == 0)
+                    {
+                        failCount = 0;
+                        workPoints.push_back({ leastPercentClass, point });
+                        tilePoints.push_back({ leastPercentClass, point });
+                        layers[leastPercentClass].sampleCount++;
+                        grids[leastPercentClass].AddPoint((int)workPoints.size() - 1, gridPoint[0], gridPoint[1]);
+                    }
+                    else
+                        failCount++;
+                }
+
+                // keep the bands that later tiles need
+                livePoints -= (int)(rightBand.size() + topBands[tileX].size());
+                rightBand.clear();
+                topBands[tileX].clear();
+                for (const Point& p : tilePoints)
+                {
+                    if (p.v[0] >= 1.0f - band)
+                        rightBand.push_back(p);
+                    if (p.v[1] >= 1.0f - band)
+                        topBands[tileX].push_back(p);
+                }
+                livePoints += (int)(rightBand.size() + topBands[tileX].size());
+                stats.maxLivePoints = std::max(stats.maxLivePoints, livePoints);
+
+                // pass the tile on, with the classes in the order that the user asked for
+                for (Point& p : tilePoints)
+                    p.classIndex = layers[p.classIndex].originalIndex;
+                onTile(tileX, tileY, tilePoints);
+                stats.pointCount += (long long)tilePoints.size();
+            }
+        }
+        printf("\r100%%\n");
+
+        return stats;
+    }
+
+    // Streams the points to a text file as they are made, one "class x y" line each, in units of tiles
+    template <size_t N, typename RNG>
+    Stats MakeToTextFile(const char* fileName, const float(&radii)[N], int targetCountPerTile, int tilesX, int tilesY, RNG& rng)
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "wt");
+        if (!file)
+        {
+            printf("Streaming::MakeToTextFile(): could not open %s for writing\n", fileName);
+            return Stats();
+        }
+
+        Stats stats = Make(radii, targetCountPerTile, tilesX, tilesY, rng,
+            [file](int tileX, int tileY, const std::vector<Point>& points)
+            {
+                for (const Point& p : points)
+                    fprintf(file, "%i %f %f\n", p.classIndex, double(tileX) + double(p.v[0]), double(tileY) + double(p.v[1]));
+            }
+        );
+
+        fclose(file);
+        return stats;
+    }
+};
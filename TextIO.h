@@ -0,0 +1,443 @@
+#pragma once
+
+#include <charconv>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// Fast reading and writing of the text formats that MakeSamplesImage makes: .txt ("class x y" lines), .csv and .h.
+//
+// Writing formats points in parallel chunks with std::to_chars, into a buffer per chunk, which are written in order.
+// Floats are formatted the way printf's %f does, so the files are byte for byte the same as fprintf would make.
+//
+// Reading memory maps the file, splits it into chunks that start after a newline, and parses the chunks in parallel.
+// Plain decimals are parsed here, and anything else with std::from_chars. Like fscanf, reading stops at the first
+// thing that isn't a point, keeping the points before it.
+
+namespace TextIO
+{
+    enum class Format
+    {
+        Text,       // 0 0.500000 0.250000
+        CSV,        // "0","0.500000","0.250000"
+        Header      //     { 0, 0.500000f, 0.250000f },
+    };
+
+    // Enough for any line. A float's %f can be 47 characters, and an int 11.
+    static const size_t c_maxLineSize = 160;
+    static const size_t c_typicalLineSize = 40;
+    static const int c_writeChunkSize = 16384;
+    static const size_t c_readChunkSize = 1 << 20;
+
+    inline char* AppendString(char* out, const char* s, size_t length)
+    {
+        memcpy(out, s, length);
+        return out + length;
+    }
+
+    inline char* AppendInt(char* out, int value)
+    {
+        // class indices are almost always one digit
+        if (value >= 0 && value < 10)
+        {
+            *out = char('0' + value);
+            return out + 1;
+        }
+        return std::to_chars(out, out + 16, value).ptr;
+    }
+
+    inline void AppendTwoDigits(char* out, uint32_t value)
+    {
+        static const char c_digitPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        memcpy(out, &c_digitPairs[value * 2], 2);
+    }
+
+    // The same text as printf("%f"), which gets the float promoted to a double and rounds its exact value to 6
+    // decimals, ties to even. For floats in [2^-40, 2^23) that is done here in integers: the float is m * 2^-shift
+    // exactly, so it's m * 10^6 >> shift millionths, and the bits shifted out decide the rounding. Anything else goes
+    // through std::to_chars, which rounds the same way.
+    inline char* AppendFloat(char* out, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        int exponent = int((bits >> 23) & 0xFF);
+        int shift = 150 - exponent;
+        if (exponent == 0 || shift <= 0 || shift > 63)
+            return std::to_chars(out, out + 64, double(value), std::chars_format::fixed, 6).ptr;
+
+        if (bits >> 31)
+            *out++ = '-';
+
+        uint64_t scaled = uint64_t((bits & 0x7FFFFF) | 0x800000) * 1000000;
+        uint64_t millionths = scaled >> shift;
+        uint64_t remainder = scaled & ((uint64_t(1) << shift) - 1);
+        uint64_t half = uint64_t(1) << (shift - 1);
+        millionths += uint64_t(remainder > half) | (uint64_t(remainder == half) & millionths);
+
+        uint64_t whole = millionths / 1000000;
+        if (whole < 10)
+            *out++ = char('0' + whole);
+        else
+            out = std::to_chars(out, out + 24, whole).ptr;
+        *out++ = '.';
+        uint32_t fraction = uint32_t(millionths - whole * 1000000);
+        AppendTwoDigits(out, fraction / 10000);
+        AppendTwoDigits(out + 2, (fraction / 100) % 100);
+        AppendTwoDigits(out + 4, fraction % 100);
+        return out + 6;
+    }
+
+    inline char* AppendPoint(char* out, const Point& p, Format format)
+    {
+        switch (format)
+        {
+            case Format::Text:
+            {
+                out = AppendInt(out, p.classIndex);
+                *out++ = ' ';
+                out = AppendFloat(out, p.v[0]);
+                *out++ = ' ';
+                out = AppendFloat(out, p.v[1]);
+                *out++ = '\n';
+                break;
+            }
+            case Format::CSV:
+            {
+                *out++ = '"';
+                out = AppendInt(out, p.classIndex);
+                out = AppendString(out, "\",\"", 3);
+                out = AppendFloat(out, p.v[0]);
+                out = AppendString(out, "\",\"", 3);
+                out = AppendFloat(out, p.v[1]);
+                out = AppendString(out, "\"\n", 2);
+                break;
+            }
+            case Format::Header:
+            {
+                out = AppendString(out, "    { ", 6);
+                out = AppendInt(out, p.classIndex);
+                out = AppendString(out, ", ", 2);
+                out = AppendFloat(out, p.v[0]);
+                out = AppendString(out, "f, ", 3);
+                out = AppendFloat(out, p.v[1]);
+                out = AppendString(out, "f },\n", 5);
+                break;
+            }
+        }
+        return out;
+    }
+
+    // Writes the points, with the header and footer text that the format has
+    inline bool Write(const char* fileName, const std::vector<Point>& points, Format format)
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "wb");
+        if (!file)
+        {
+            printf("TextIO::Write(): could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        if (format == Format::CSV)
+            fputs("\"Class\",\"x\",\"y\"\n", file);
+        else if (format == Format::Header)
+        {
+            fputs(
+                "struct MultiClassPoint\n"
+                "{\n"
+                "    int classIndex;\n"
+                "    float x;\n"
+                "    float y;\n"
+                "};\n"
+                "\n"
+                "MultiClassPoint points[] =\n"
+                "{\n",
+                file
+            );
+        }
+
+        // Format a few chunks per thread at a time, so memory use doesn't grow with the point count
+        ThreadPool& threadPool = GetThreadPool();
+        int chunkCount = int((points.size() + c_writeChunkSize - 1) / c_writeChunkSize);
+        int chunksPerPass = threadPool.ThreadCount() * 4;
+        std::vector<std::vector<char>> buffers(std::min(chunkCount, chunksPerPass));
+        std::vector<size_t> bufferSizes(buffers.size());
+        for (int passStart = 0; passStart < chunkCount; passStart += chunksPerPass)
+        {
+            int passChunkCount = std::min(chunksPerPass, chunkCount - passStart);
+            threadPool.ParallelFor(passChunkCount,
+                [&](int index, int threadIndex)
+                {
+                    size_t begin = size_t(passStart + index) * c_writeChunkSize;
+                    size_t end = std::min(begin + c_writeChunkSize, points.size());
+
+                    // The buffer starts out sized for lines of %f values in [0,1), and grows if it needs to, rather
+                    // than being sized for the longest lines up front, which would zero far more memory than is used.
+                    std::vector<char>& buffer = buffers[index];
+                    buffer.resize(std::max(buffer.size(), (end - begin) * c_typicalLineSize));
+                    size_t used = 0;
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        if (buffer.size() < used + c_maxLineSize)
+                            buffer.resize(std::max(used + c_maxLineSize, buffer.size() * 2));
+                        used = size_t(AppendPoint(buffer.data() + used, points[i], format) - buffer.data());
+                    }
+                    bufferSizes[index] = used;
+                }
+            );
+
+            for (int index = 0; index < passChunkCount; ++index)
+                fwrite(buffers[index].data(), 1, bufferSizes[index], file);
+        }
+
+        if (format == Format::Header)
+            fputs("};\n", file);
+
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    // Parses a float the way fscanf's %f does, correctly rounded. Plain decimals, like %f and %g write, are done
+    // here, with the fraction read up to 8 digits at a time. The digits make an integer w, with q decimals:
+    //  - When w < 2^24 and q <= 10, w and 10^q are exact floats, so w / 10^q is one correctly rounded division.
+    //  - When w < 2^53 and q <= 22, they are exact doubles, and w / 10^q is a correctly rounded double. Rounding that
+    //    to a float gives the correctly rounded float, unless the double is exactly halfway between two floats,
+    //    because the exact quotient is within half a double ulp of it, so it is on the same side of every other
+    //    halfway point.
+    // Anything else, like exponents, or halfway doubles, goes through std::from_chars.
+    inline const char* ParseFloat(const char* p, const char* end, float& value)
+    {
+        static const float c_floatPowersOfTen[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+        static const double c_doublePowersOfTen[] =
+        {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        static const uint64_t c_uintPowersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+        static const uint64_t c_maxExactDouble = uint64_t(1) << 53;
+
+        const char* start = p;
+        bool negative = (p < end && *p == '-');
+        if (negative)
+            p++;
+
+        // Digits stop being taken once w reaches 2^53, which leaves more digits for the check below to find
+        uint64_t digits = 0;
+        int decimals = 0;
+        const char* digitsStart = p;
+        while (p < end && *p >= '0' && *p <= '9' && digits < c_maxExactDouble)
+            digits = digits * 10 + uint64_t(*p++ - '0');
+        bool hasDigits = p > digitsStart;
+        if (p < end && *p == '.')
+        {
+            p++;
+            const char* fractionStart = p;
+
+            // 8 bytes at a time, while w * 10^8 + 99999999 still fits in 64 bits. The first byte is the low byte.
+            // The digits are the bytes below the first one that isn't a digit, and they are shifted up to the top of
+            // the chunk, which parses them as if they had leading zeros.
+            while (end - p >= 8 && digits < 10000000000ull)
+            {
+                uint64_t chunk;
+                memcpy(&chunk, p, sizeof(chunk));
+                chunk -= 0x3030303030303030ull;
+                uint64_t nonDigits = (chunk | (chunk + 0x0606060606060606ull)) & 0xF0F0F0F0F0F0F0F0ull;
+                int count = 8;
+                if (nonDigits)
+                {
+                    // each non digit byte has a bit set in its high nibble, so the lowest set bit is in the first one
+#if defined(_MSC_VER)
+                    unsigned long bit;
+                    _BitScanForward64(&bit, nonDigits);
+                    count = int(bit / 8);
+#else
+                    count = __builtin_ctzll(nonDigits) / 8;
+#endif
+                    if (count == 0)
+                        break;
+                    chunk <<= 8 * (8 - count);
+                }
+
+                // pairs of digits, then groups of 4, then all 8
+                chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFull;
+                chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFull;
+                chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000FFFFFFFFull;
+                digits = digits * c_uintPowersOfTen[count] + chunk;
+                p += count;
+                if (count < 8)
+                    break;
+            }
+            while (p < end && *p >= '0' && *p <= '9' && digits < c_maxExactDouble)
+                digits = digits * 10 + uint64_t(*p++ - '0');
+
+            decimals = int(p - fractionStart);
+            hasDigits = hasDigits || p > fractionStart;
+        }
+
+        bool ended = p >= end || !((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E');
+        if (hasDigits && ended)
+        {
+            if (digits < (1u << 24) && decimals <= 10)
+            {
+                value = float(digits) / c_floatPowersOfTen[decimals];
+                if (negative)
+                    value = -value;
+                return p;
+            }
+            if (digits < c_maxExactDouble && decimals <= 22)
+            {
+                double quotient = double(digits) / c_doublePowersOfTen[decimals];
+                uint64_t bits;
+                memcpy(&bits, &quotient, sizeof(bits));
+                if ((bits & 0x1FFFFFFF) != 0x10000000)
+                {
+                    value = float(quotient);
+                    if (negative)
+                        value = -value;
+                    return p;
+                }
+            }
+        }
+
+        std::from_chars_result result = std::from_chars(start, end, value);
+        return (result.ec == std::errc()) ? result.ptr : nullptr;
+    }
+
+    // Parses points from [begin, end), adding them to points. Returns false if it stopped at something that isn't
+    // a point. CSV quotes and commas are skipped like whitespace.
+    inline bool ParsePoints(const char* begin, const char* end, Format format, std::vector<Point>& points)
+    {
+        auto IsSeparator = [format](char c)
+        {
+            // the characters that isspace() is true for: space, and \t \n \v \f \r
+            if (c == ' ' || (c >= '\t' && c <= '\r'))
+                return true;
+            return format == Format::CSV && (c == '"' || c == ',');
+        };
+
+        const char* p = begin;
+        auto SkipSeparators = [&]()
+        {
+            while (p < end && IsSeparator(*p))
+                p++;
+            // from_chars doesn't take a plus sign, but fscanf does
+            if (p < end && *p == '+')
+                p++;
+        };
+
+        while (true)
+        {
+            SkipSeparators();
+            if (p >= end)
+                return true;
+
+            // class indices are almost always one digit
+            Point point;
+            if (end - p >= 2 && *p >= '0' && *p <= '9' && !(p[1] >= '0' && p[1] <= '9'))
+                point.classIndex = *p++ - '0';
+            else
+            {
+                std::from_chars_result result = std::from_chars(p, end, point.classIndex);
+                if (result.ec != std::errc())
+                    return false;
+                p = result.ptr;
+            }
+
+            for (float& f : point.v)
+            {
+                SkipSeparators();
+                p = ParseFloat(p, end, f);
+                if (!p)
+                    return false;
+            }
+
+            points.push_back(point);
+        }
+    }
+
+    // Reads a .txt or .csv file of points
+    inline std::vector<Point> Read(const char* fileName, Format format = Format::Text)
+    {
+        std::vector<Point> ret;
+
+        MappedFile file;
+        if (!file.Open(fileName))
+        {
+            printf("TextIO::Read(): could not open %s\n", fileName);
+            return ret;
+        }
+
+        const char* begin = (const char*)file.Data();
+        const char* end = begin + file.Size();
+
+        // the csv header line isn't points
+        if (format == Format::CSV)
+        {
+            const char* newline = (const char*)memchr(begin, '\n', size_t(end - begin));
+            begin = newline ? newline + 1 : end;
+        }
+
+        // With one chunk, or one thread, there's nothing to do in parallel, so the file is parsed straight into ret
+        ThreadPool& threadPool = GetThreadPool();
+        size_t size = size_t(end - begin);
+        int chunkCount = int((size + c_readChunkSize - 1) / c_readChunkSize);
+        ret.reserve(size / 16);
+        if (chunkCount <= 1 || threadPool.ThreadCount() == 1)
+        {
+            ParsePoints(begin, end, format, ret);
+            return ret;
+        }
+
+        // Chunks start just after the first newline at or after their even split, so no line is split
+        std::vector<const char*> chunkStarts(chunkCount + 1, end);
+        for (int i = 0; i < chunkCount; ++i)
+        {
+            const char* start = begin + size_t(i) * c_readChunkSize;
+            if (i > 0)
+            {
+                const char* newline = (const char*)memchr(start - 1, '\n', size_t(end - start + 1));
+                start = newline ? newline + 1 : end;
+            }
+            chunkStarts[i] = (i > 0) ? std::max(start, chunkStarts[i - 1]) : start;
+        }
+
+        // Parse a few chunks per thread at a time, into buffers that are reused, so that the points are only written
+        // to newly allocated memory once, when they are added to ret. Stop after the first chunk that had something
+        // that isn't a point.
+        int chunksPerPass = threadPool.ThreadCount() * 4;
+        std::vector<std::vector<Point>> chunkPoints(std::min(chunkCount, chunksPerPass));
+        std::vector<char> chunkOK(chunkPoints.size(), 1);
+        for (int passStart = 0; passStart < chunkCount; passStart += chunksPerPass)
+        {
+            int passChunkCount = std::min(chunksPerPass, chunkCount - passStart);
+            threadPool.ParallelFor(passChunkCount,
+                [&](int index, int threadIndex)
+                {
+                    chunkPoints[index].clear();
+                    chunkPoints[index].reserve((chunkStarts[passStart + index + 1] - chunkStarts[passStart + index]) / 16);
+                    chunkOK[index] = ParsePoints(chunkStarts[passStart + index], chunkStarts[passStart + index + 1], format, chunkPoints[index]) ? 1 : 0;
+                }
+            );
+
+            for (int index = 0; index < passChunkCount; ++index)
+            {
+                ret.insert(ret.end(), chunkPoints[index].begin(), chunkPoints[index].end());
+                if (!chunkOK[index])
+                    return ret;
+            }
+        }
+
+        return ret;
+    }
+};
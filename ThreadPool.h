@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent pool of worker threads for data parallel loops.
+// The calling thread works too, so a pool of N threads has N-1 workers.
+class ThreadPool
+{
+public:
+    ThreadPool(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(int(std::thread::hardware_concurrency()), 1);
+
+        m_threadCount = threadCount;
+        for (int i = 1; i < threadCount; ++i)
+            m_workers.emplace_back([this, i]() { WorkerThread(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    int ThreadCount() const
+    {
+        return m_threadCount;
+    }
+
+    // Calls func(index, threadIndex) for every index in [0, count), and returns when they are all done.
+    // threadIndex is in [0, ThreadCount()) and can be used to index per thread scratch memory.
+    // Indices are handed out in batches of batchSize. Calls from inside a worker run serially.
+    template <typename LAMBDA>
+    void ParallelFor(int count, const LAMBDA& func, int batchSize = 1)
+    {
+        if (count <= 0)
+            return;
+
+        batchSize = std::max(batchSize, 1);
+        if (m_threadCount == 1 || count <= batchSize || IsWorkerThread())
+        {
+            for (int index = 0; index < count; ++index)
+                func(index, 0);
+            return;
+        }
+
+        // only one loop runs on the pool at a time
+        std::lock_guard<std::mutex> loopLock(m_loopMutex);
+
+        std::atomic<int> nextIndex(0);
+        std::function<void(int)> job = [&](int threadIndex)
+        {
+            while (true)
+            {
+                int begin = nextIndex.fetch_add(batchSize);
+                if (begin >= count)
+                    break;
+                int end = std::min(begin + batchSize, count);
+                for (int index = begin; index < end; ++index)
+                    func(index, threadIndex);
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_jobGeneration++;
+            m_workersBusy = (int)m_workers.size();
+        }
+        m_wake.notify_all();
+
+        IsWorkerThread() = true;
+        job(0);
+        IsWorkerThread() = false;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_workersBusy == 0; });
+        m_job = nullptr;
+    }
+
+private:
+    static bool& IsWorkerThread()
+    {
+        static thread_local bool isWorker = false;
+        return isWorker;
+    }
+
+    void WorkerThread(int threadIndex)
+    {
+        IsWorkerThread() = true;
+        uint64_t lastGeneration = 0;
+        while (true)
+        {
+            std::function<void(int)>* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_quit || m_jobGeneration != lastGeneration; });
+                if (m_quit)
+                    return;
+                lastGeneration = m_jobGeneration;
+                job = m_job;
+            }
+
+            (*job)(threadIndex);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_workersBusy--;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    int m_threadCount = 1;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_loopMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::function<void(int)>* m_job = nullptr;
+    uint64_t m_jobGeneration = 0;
+    int m_workersBusy = 0;
+    bool m_quit = false;
+};
+
+// The pool shared by everything in the program
+inline ThreadPool& GetThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
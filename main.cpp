@@ -4,16 +4,20 @@
 #include <vector>
 #include <array>
 #include <direct.h>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb/stb_image_write.h"
+#undef STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "Random.h"
+#include "RandomSIMD.h"
 #include "MathUtils.h"
 #include "IndexToColor.h"
+#include "CandidateSources.h"
 
 struct Point
 {
@@ -24,37 +28,24 @@ struct Point
 #include "Hard.h"
 #include "Soft.h"
 #include "HardAdaptive.h"
-
-void DrawDot(unsigned char* pixels, int imageSize, int x, int y, float radius, const unsigned char (&RGB)[3])
-{
-    int paddedRadius = int(radius) + 3;
-
-    for (int iy = -paddedRadius; iy <= paddedRadius; ++iy)
-    {
-        int py = (y + iy + imageSize) % imageSize;
-        for (int ix = -paddedRadius; ix <= paddedRadius; ++ix)
-        {
-            int px = (x + ix + imageSize) % imageSize;
-
-            float distanceToSurface = ToroidalDistance(Vec2{ (float)x, (float)y }, Vec2{ (float)px, (float)py }, float(imageSize));
-            distanceToSurface -= radius;
-
-            float alpha = 1.0f - SmoothStep(0.0f, 2.0f, distanceToSurface);
-
-            if (alpha > 0)
-            {
-                unsigned char* pixel = &pixels[(py * imageSize + px) * 3];
-                pixel[0] = (unsigned char)Lerp((float)pixel[0], (float)RGB[0], alpha);
-                pixel[1] = (unsigned char)Lerp((float)pixel[1], (float)RGB[1], alpha);
-                pixel[2] = (unsigned char)Lerp((float)pixel[2], (float)RGB[2], alpha);
-            }
-        }
-    }
-}
-
-void MakeSamplesImage(const char* baseFileName, const std::vector<Point>& points, int imageSize = 256, float dotSize = 0.5f)
+#include "Metrics.h"
+#include "VoidAndCluster.h"
+#include "FarthestPoint.h"
+#include "Relax.h"
+#include "GradientDescent.h"
+#include "CornerTiles.h"
+#include "Streaming.h"
+#include "PointFile.h"
+#include "TextIO.h"
+#include "PNG.h"
+#include "OutputPipeline.h"
+#include "SampleImages.h"
+#include "DFT.h"
+#include "Periodogram.h"
+
+// Prints how many points of each class there are
+void PrintSamplesInfo(const char* baseFileName, const std::vector<Point>& points)
 {
-    // show metrics
     float minX = FLT_MAX;
     float minY = FLT_MAX;
     float maxX = -FLT_MAX;
@@ -75,114 +66,125 @@ void MakeSamplesImage(const char* baseFileName, const std::vector<Point>& points
     for (int i = 0; i < classCounts.size(); ++i)
         printf("  %i : %i\n", i, classCounts[i]);
     //printf("min/max = (%f, %f) - (%f, %f)\n", minX, minY, maxX, maxY);
+}
 
-    // Make text files
-    {
-        // text file
+int GetClassCount(const std::vector<Point>& points)
+{
+    int classCount = 0;
+    for (const Point& p : points)
+        classCount = std::max(classCount, p.classIndex + 1);
+    return classCount;
+}
+
+// Image i of the subset images shows the classes whose bits are set in i + 1. This is that as 0s and 1s, last class first.
+std::vector<char> ClassSubsetString(int imageIndex, int classCount)
+{
+    std::vector<char> mask(classCount + 1, 0);
+    for (int j = 0; j < classCount; ++j)
+        mask[classCount - j - 1] = (((imageIndex + 1) & (1 << j)) != 0) ? '1' : '0';
+    return mask;
+}
+
+// How the sinks that make images compress their PNGs
+struct SamplesPNGSettings
+{
+    PNG::Compression color = PNG::Compression::Fast;
+    PNG::Compression bw = PNG::Compression::Fast;
+    PNG::Compression tiled = PNG::Compression::Fast;
+    PNG::Compression periodogram = PNG::Compression::Fast;
+};
+
+// Adds a sink for each kind of file that MakeSamplesImage makes. They can be turned off by name.
+void AddSamplesSinks(OutputPipeline& pipeline, int imageSize = 256, float dotSize = 0.5f, const SamplesPNGSettings& pngSettings = SamplesPNGSettings())
+{
+    // text file
+    pipeline.AddSink("txt",
+        [](const OutputPipeline::Job& job)
         {
             char fileName[1024];
-            sprintf(fileName, "%s.txt", baseFileName);
-            FILE* file = nullptr;
-            fopen_s(&file, fileName, "wb");
-            for (const Point& p : points)
-                fprintf(file, "%i %f %f\n", p.classIndex, p.v[0], p.v[1]);
-            fclose(file);
+            sprintf(fileName, "%s.txt", job.baseFileName.c_str());
+            TextIO::Write(fileName, job.points, TextIO::Format::Text);
         }
+    );
 
-        // csv file
+    // csv file
+    pipeline.AddSink("csv",
+        [](const OutputPipeline::Job& job)
         {
             char fileName[1024];
-            sprintf(fileName, "%s.csv", baseFileName);
-            FILE* file = nullptr;
-            fopen_s(&file, fileName, "wb");
-            fprintf(file, "\"Class\",\"x\",\"y\"\n");
-            for (const Point& p : points)
-                fprintf(file, "\"%i\",\"%f\",\"%f\"\n", p.classIndex, p.v[0], p.v[1]);
-            fclose(file);
+            sprintf(fileName, "%s.csv", job.baseFileName.c_str());
+            TextIO::Write(fileName, job.points, TextIO::Format::CSV);
         }
+    );
 
-        // .h file
+    // .h file
+    pipeline.AddSink("h",
+        [](const OutputPipeline::Job& job)
         {
             char fileName[1024];
-            sprintf(fileName, "%s.h", baseFileName);
-            FILE* file = nullptr;
-            fopen_s(&file, fileName, "wb");
-            fprintf(file,
-                "struct MultiClassPoint\n"
-                "{\n"
-                "    int classIndex;\n"
-                "    float x;\n"
-                "    float y;\n"
-                "};\n"
-                "\n"
-                "MultiClassPoint points[] =\n"
-                "{\n"
-            );
-            for (const Point& p : points)
-                fprintf(file, "    { %i, %ff, %ff },\n", p.classIndex, p.v[0], p.v[1]);
-            fprintf(file, "};\n");
-            fclose(file);
+            sprintf(fileName, "%s.h", job.baseFileName.c_str());
+            TextIO::Write(fileName, job.points, TextIO::Format::Header);
         }
-    }
-
-    // make images
-    {
-        int imageCount = (1 << classCounts.size()) - 1;
+    );
 
-        std::vector<std::vector<unsigned char>> images(imageCount);
-        std::vector<std::vector<unsigned char>> imagesbw(imageCount);
-        for (auto& pixels : images)
-            pixels.resize(imageSize * imageSize * 3, 255);
-        for (auto& pixels : imagesbw)
-            pixels.resize(imageSize * imageSize, 255);
-
-        for (const Point& p : points)
+    // binary file
+    pipeline.AddSink("pts",
+        [](const OutputPipeline::Job& job)
         {
-            Vec3 RGBf = IndexToColor(p.classIndex, 1.0f, 0.95f);
-            unsigned char RGBU8[3] = {
-                (unsigned char)Clamp(RGBf[0] * 256.0f, 0.0f, 255.0f),
-                (unsigned char)Clamp(RGBf[1] * 256.0f, 0.0f, 255.0f),
-                (unsigned char)Clamp(RGBf[2] * 256.0f, 0.0f, 255.0f)
-            };
-
-            int x = (int)Clamp(p.v[0] * float(imageSize), 0.0f, float(imageSize - 1));
-            int y = (int)Clamp(p.v[1] * float(imageSize), 0.0f, float(imageSize - 1));
+            char fileName[1024];
+            sprintf(fileName, "%s.pts", job.baseFileName.c_str());
+            PointFile::Write(fileName, job.points, job.info);
+        }
+    );
 
-            for (int i = 0; i < imageCount; ++i)
+    // color images of each subset of classes
+    pipeline.AddSink("color",
+        [imageSize, dotSize, pngSettings](const OutputPipeline::Job& job)
+        {
+            int classCount = GetClassCount(job.points);
+            SampleImages::Layers layers = SampleImages::DrawLayers(job.points, classCount, imageSize, dotSize, true, false);
+            for (int i = 0; i < (1 << classCount) - 1; ++i)
             {
-                if ((i + 1) & (1 << p.classIndex))
-                {
-                    DrawDot(images[i].data(), imageSize, x, y, dotSize, RGBU8);
-                    imagesbw[i][y * imageSize + x] = 0;
-                }
+                char fileName[1024];
+                sprintf(fileName, "%s_color.%s.png", job.baseFileName.c_str(), ClassSubsetString(i, classCount).data());
+                PNG::Write(fileName, imageSize, imageSize, 3, SampleImages::CompositeColor(layers, i + 1).data(), pngSettings.color);
             }
         }
+    );
 
-        for (int i = 0; i < imageCount; ++i)
+    // black and white images of each subset of classes
+    pipeline.AddSink("bw",
+        [imageSize, pngSettings](const OutputPipeline::Job& job)
         {
-            std::vector<char> mask(classCounts.size()+1, 0);
-            for (int j = 0; j < classCounts.size(); ++j)
-                mask[classCounts.size() - j - 1] = (((i + 1) & (1 << j)) != 0) ? '1' : '0';
-
-            char fileName[1024];
-
-            sprintf(fileName, "%s_color.%s.png", baseFileName, mask.data());
-            stbi_write_png(fileName, imageSize, imageSize, 3, images[i].data(), 0);
-
-            sprintf(fileName, "%s_bw.%s.png", baseFileName, mask.data());
-            stbi_write_png(fileName, imageSize, imageSize, 1, imagesbw[i].data(), 0);
+            int classCount = GetClassCount(job.points);
+            SampleImages::Layers layers = SampleImages::DrawLayers(job.points, classCount, imageSize, 0.0f, false, true);
+            for (int i = 0; i < (1 << classCount) - 1; ++i)
+            {
+                char fileName[1024];
+                sprintf(fileName, "%s_bw.%s.png", job.baseFileName.c_str(), ClassSubsetString(i, classCount).data());
+                PNG::WriteBW(fileName, imageSize, imageSize, SampleImages::CompositeBW(layers, i + 1).data(), pngSettings.bw);
+            }
         }
+    );
 
-        // make a tiled image
+    // the color image of all classes, tiled 3x3. It draws its own layers, which is about a tenth of the time it takes
+    // to write the tiled PNG, so that it can be turned off on its own.
+    pipeline.AddSink("tiled",
+        [imageSize, dotSize, pngSettings](const OutputPipeline::Job& job)
         {
-            char fileName[1024];
+            int classCount = GetClassCount(job.points);
+            if (classCount == 0)
+                return;
+
+            SampleImages::Layers layers = SampleImages::DrawLayers(job.points, classCount, imageSize, dotSize, true, false);
+            std::vector<unsigned char> image = SampleImages::CompositeColor(layers, (1 << classCount) - 1);
 
             std::vector<unsigned char> tiled(imageSize * imageSize * 3 * 9, 255);
             unsigned char* dest = tiled.data();
 
             for (int i = 0; i < imageSize * 3; ++i)
             {
-                const unsigned char* src = &images[images.size() - 1][(i % imageSize) * imageSize * 3];
+                const unsigned char* src = &image[(i % imageSize) * imageSize * 3];
 
                 memcpy(dest, src, imageSize * 3);
                 dest += imageSize * 3;
@@ -194,15 +196,76 @@ void MakeSamplesImage(const char* baseFileName, const std::vector<Point>& points
                 dest += imageSize * 3;
             }
 
-            sprintf(fileName, "%s_color.tiled.png", baseFileName);
-            stbi_write_png(fileName, imageSize * 3, imageSize * 3, 3, tiled.data(), 0);
+            char fileName[1024];
+            sprintf(fileName, "%s_color.tiled.png", job.baseFileName.c_str());
+            PNG::Write(fileName, imageSize * 3, imageSize * 3, 3, tiled.data(), pngSettings.tiled);
         }
-    }
+    );
+
+    // periodograms of each subset of classes, made from the points, at the frequencies of the images' DFTs, and their
+    // radially averaged power. That's 2^N - 1 spectra per point set, so it's off unless turned on with EnableSink().
+    pipeline.AddSink("periodogram",
+        [imageSize, pngSettings](const OutputPipeline::Job& job)
+        {
+            int classCount = GetClassCount(job.points);
+            std::vector<Periodogram::Spectrum> spectra = Periodogram::MakeSubsetSpectra(job.points, classCount, imageSize);
+
+            std::vector<std::vector<float>> radials;
+            std::vector<std::string> names;
+            for (int i = 0; i < (int)spectra.size(); ++i)
+            {
+                char fileName[1024];
+                sprintf(fileName, "%s_periodogram.%s.png", job.baseFileName.c_str(), ClassSubsetString(i, classCount).data());
+                Periodogram::WriteImage(fileName, spectra[i], 2.0f, pngSettings.periodogram);
+
+                radials.push_back(Periodogram::RadialAverage(spectra[i]));
+                names.push_back(ClassSubsetString(i, classCount).data());
+            }
+
+            char fileName[1024];
+            sprintf(fileName, "%s_periodogram.csv", job.baseFileName.c_str());
+            Periodogram::WriteRadialCSV(fileName, radials, names);
+        },
+        false
+    );
+}
+
+// Prints info about the points, and hands them to the pipeline to write
+void SubmitSamplesImage(OutputPipeline& pipeline, const char* baseFileName, std::vector<Point> points, const PointFile::Info& info = PointFile::Info())
+{
+    PrintSamplesInfo(baseFileName, points);
+    pipeline.Submit(baseFileName, std::move(points), info);
+}
+
+// Writes every kind of file for the points, before returning
+void MakeSamplesImage(const char* baseFileName, const std::vector<Point>& points, int imageSize = 256, float dotSize = 0.5f, const PointFile::Info& info = PointFile::Info())
+{
+    OutputPipeline pipeline(0);
+    AddSamplesSinks(pipeline, imageSize, dotSize);
+    SubmitSamplesImage(pipeline, baseFileName, points, info);
+}
+
+// The seed of the RNG functions below, which each use their own stream of it. It's saved in the point files of the
+// points they make.
+uint64_t RNGSeed()
+{
+    static uint64_t seed = GetSeed();
+    return seed;
+}
+
+// Fills in the seed and realization of the RNG functions, after a generator has filled in the rest of info. Points
+// made from the PCG RNGs also depend on what was made before them with the same RNG function, but with COUNTER_RNG(),
+// the seed and realization are all it takes to make them again.
+PointFile::Info RNGInfo(PointFile::Info info)
+{
+    info.seed = RNGSeed();
+    PointFile::AppendParam(info.params, "realization", RNGRealization());
+    return info;
 }
 
 Vec2 RNGContinuous()
 {
-    static pcg32_random_t rng = GetRNG();
+    static TRNG rng = GetTRNG(RNGSeed(), 0);
     return Vec2
     {
         RandomFloat01(rng),
@@ -213,7 +276,7 @@ Vec2 RNGContinuous()
 template <size_t X, size_t Y>
 Vec2 RNGDiscrete()
 {
-    static pcg32_random_t rng = GetRNG();
+    static TRNG rng = GetTRNG(RNGSeed(), 1);
     Vec2 ret = Vec2
     {
         float(RandomUint32(rng, X)) / float(X),
@@ -224,7 +287,7 @@ Vec2 RNGDiscrete()
 
 Vec2u RNGDiscreteParams(int X, int Y)
 {
-    static pcg32_random_t rng = GetRNG();
+    static TRNG rng = GetTRNG(RNGSeed(), 2);
     Vec2u ret = Vec2u
     {
         RandomUint32(rng, X),
@@ -235,47 +298,264 @@ Vec2u RNGDiscreteParams(int X, int Y)
 
 std::vector<Point> GetPointsFromTextFile(const char* fileName)
 {
+    return TextIO::Read(fileName);
+}
+
+std::vector<Point> GetPointsFromPointFile(const char* fileName)
+{
+    PointFile::Reader reader;
+    if (!reader.Open(fileName))
+        return std::vector<Point>();
+    return reader.ToPoints();
+}
+
+template <typename TCandidateSource>
+void CompareCandidateSource(const char* label, TCandidateSource& source)
+{
+    // Hard: how many trials it takes to reach the target count
+    {
+        CandidateSources::Counting<TCandidateSource> counting(source);
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        std::vector<Point> points = Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, counting, true);
+        float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("%s Hard: %i points, %llu trials, %0.2f seconds\n", label, (int)points.size(), (unsigned long long)counting.Count(), seconds);
+        Metrics::PrintNearestNeighborStats(Metrics::CalculateNearestNeighborStats(points, true));
+    }
+
+    // Soft: final quality for a few candidate multipliers. Fewer candidates for the same quality is a win.
+    for (int candidateMultiplier : { 1, 2, 5 })
+    {
+        CandidateSources::Counting<TCandidateSource> counting(source);
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        std::vector<Point> points = Soft::Make({ 25, 250, 1000 }, counting, true, candidateMultiplier);
+        float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("%s Soft x%i: %i points, %llu trials, %0.2f seconds\n", label, candidateMultiplier, (int)points.size(), (unsigned long long)counting.Count(), seconds);
+        Metrics::PrintNearestNeighborStats(Metrics::CalculateNearestNeighborStats(points, true));
+    }
+}
+
+void CompareCandidateSources()
+{
+    CompareCandidateSource("White Noise", RNGContinuous);
+
+    CandidateSources::R2 r2;
+    CompareCandidateSource("R2", r2);
+
+    CandidateSources::ScrambledSobol sobol;
+    CompareCandidateSource("Sobol", sobol);
+
+    CandidateSources::JitteredGrid jitteredGrid;
+    CompareCandidateSource("Jittered Grid", jitteredGrid);
+}
+
+// Soft's exact and fast kernels: the fast kernel's error, and the time and quality of each
+void CompareSoftKernels()
+{
+    printf("Fast kernel max error per Gaussian: %e\n", Soft::FastExpMaxError());
+
+    for (Soft::Kernel kernel : { Soft::Kernel::Exact, Soft::Kernel::Fast })
+    {
+        Soft::Settings settings;
+        settings.kernel = kernel;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        std::vector<Point> points = Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true, settings);
+        float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("%s kernel: %0.2f seconds\n", (kernel == Soft::Kernel::Exact) ? "Exact" : "Fast", seconds);
+        Metrics::PrintNearestNeighborStats(Metrics::CalculateNearestNeighborStats(points, true));
+    }
+}
+
+// Soft quality vs time for the candidate policies, printed and written to out/SoftCandidatePolicies.csv
+void CompareSoftCandidatePolicies()
+{
+    struct Config
+    {
+        const char* label;
+        Soft::CandidatePolicy policy;
+        int budget;
+    };
+
+    const Config configs[] =
+    {
+        { "Multiplier", Soft::CandidatePolicy::Multiplier, 1 },
+        { "Multiplier", Soft::CandidatePolicy::Multiplier, 2 },
+        { "Multiplier", Soft::CandidatePolicy::Multiplier, 5 },
+        { "Fixed", Soft::CandidatePolicy::Fixed, 16 },
+        { "Fixed", Soft::CandidatePolicy::Fixed, 64 },
+        { "Fixed", Soft::CandidatePolicy::Fixed, 256 },
+        { "Log", Soft::CandidatePolicy::Log, 4 },
+        { "Log", Soft::CandidatePolicy::Log, 16 },
+        { "Log", Soft::CandidatePolicy::Log, 64 },
+    };
+
     FILE* file = nullptr;
-    fopen_s(&file, fileName, "rt");
+    fopen_s(&file, "out/SoftCandidatePolicies.csv", "wb");
+    if (file)
+        fprintf(file, "\"Policy\",\"Budget\",\"Void Percent\",\"Seconds\",\"Class 0 NN Min\",\"Class 1 NN Min\",\"Class 2 NN Min\",\"All NN Min\",\"All NN Mean\"\n");
 
-    std::vector<Point> ret;
-    while (true)
+    for (const Config& config : configs)
     {
-        int a;
-        float b, c;
-        if (fscanf(file, "%i %f %f", &a, &b, &c) != 3)
-            break;
+        for (int voidCandidatePercent : { 0, 50 })
+        {
+            // the multiplier policy is the baseline, so only do it the original way
+            if (config.policy == Soft::CandidatePolicy::Multiplier && voidCandidatePercent > 0)
+                continue;
+
+            Soft::Settings settings;
+            settings.candidatePolicy = config.policy;
+            settings.candidateMultiplier = config.budget;
+            settings.candidateBudget = config.budget;
+            settings.voidCandidatePercent = voidCandidatePercent;
+
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            std::vector<Point> points = Soft::Make({ 25, 250, 1000 }, RNGContinuous, true, settings);
+            float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+            std::vector<Metrics::NearestNeighborStats> stats = Metrics::CalculateNearestNeighborStats(points, true);
+            printf("%s %i, %i%% void candidates: %0.2f seconds\n", config.label, config.budget, voidCandidatePercent, seconds);
+            Metrics::PrintNearestNeighborStats(stats);
+
+            if (file)
+                fprintf(file, "\"%s\",\"%i\",\"%i\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\"\n", config.label, config.budget, voidCandidatePercent, seconds, stats[0].normalizedMin, stats[1].normalizedMin, stats[2].normalizedMin, stats[3].normalizedMin, stats[3].normalizedMean);
+        }
+    }
+
+    if (file)
+        fclose(file);
+}
 
-        ret.push_back({ a, {b, c} });
+// Makes the average DFT of the black and white image of each class subset, over the point sets, like MultiDFT.py.
+// They are written as <baseFileName>_bw.<subset>.dft.png, and the average images as <baseFileName>_bw.<subset>.avg.png.
+void DoDFTs(const char* baseFileName, const std::vector<std::vector<Point>>& pointSets, int imageSize = 256)
+{
+    if (!FFT::IsPowerOf2(imageSize))
+    {
+        printf("DoDFTs(): image size %i isn't a power of 2\n", imageSize);
+        return;
     }
 
-    fclose(file);
+    int classCount = 0;
+    for (const std::vector<Point>& points : pointSets)
+        classCount = std::max(classCount, GetClassCount(points));
+    int subsetCount = (1 << classCount) - 1;
 
-    return ret;
+    // images[subset][point set]
+    std::vector<std::vector<std::vector<unsigned char>>> images(subsetCount, std::vector<std::vector<unsigned char>>(pointSets.size()));
+    for (size_t setIndex = 0; setIndex < pointSets.size(); ++setIndex)
+    {
+        SampleImages::Layers layers = SampleImages::DrawLayers(pointSets[setIndex], classCount, imageSize, 0.0f, false, true);
+        for (int i = 0; i < subsetCount; ++i)
+            images[i][setIndex] = SampleImages::CompositeBW(layers, i + 1);
+    }
+
+    std::vector<std::vector<const unsigned char*>> imageSets(subsetCount);
+    for (int i = 0; i < subsetCount; ++i)
+    {
+        for (const std::vector<unsigned char>& image : images[i])
+            imageSets[i].push_back(image.data());
+    }
+    std::vector<std::vector<float>> dfts = DFT::AverageLogMagnitudes(imageSets, imageSize);
+
+    for (int i = 0; i < subsetCount; ++i)
+    {
+        char fileName[1024];
+        sprintf(fileName, "%s_bw.%s.dft.png", baseFileName, ClassSubsetString(i, classCount).data());
+        DFT::WriteColorMap(fileName, dfts[i], imageSize, 0.0f, 5.0f);
+
+        std::vector<unsigned char> average(imageSize * imageSize);
+        for (int pixel = 0; pixel < imageSize * imageSize; ++pixel)
+        {
+            int sum = 0;
+            for (const std::vector<unsigned char>& image : images[i])
+                sum += image[pixel];
+            average[pixel] = (unsigned char)(sum / int(images[i].size()));
+        }
+        sprintf(fileName, "%s_bw.%s.avg.png", baseFileName, ClassSubsetString(i, classCount).data());
+        PNG::Write(fileName, imageSize, imageSize, 1, average.data(), PNG::Compression::Fast);
+    }
 }
 
-void DoDFTs(const char* fileNamePattern, int numClasses)
+// Makes the average periodogram of each class subset, over the point sets, straight from the points. They are written
+// as <baseFileName>_periodogram.<subset>.png, with the radially averaged power of every subset in
+// <baseFileName>_periodogram.csv and .png, and the anisotropy in <baseFileName>_anisotropy.csv and .png.
+void DoPeriodograms(const char* baseFileName, const std::vector<std::vector<Point>>& pointSets, int size = 256)
 {
-    int imagePatterns = (1 << numClasses) - 1;
-    std::vector<char> pattern(numClasses + 1, 0);
-    for (int imageIndex = 0; imageIndex < imagePatterns; ++imageIndex)
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    int classCount = 0;
+    for (const std::vector<Point>& points : pointSets)
+        classCount = std::max(classCount, GetClassCount(points));
+    int subsetCount = (1 << classCount) - 1;
+
+    Periodogram::Average average;
+    for (const std::vector<Point>& points : pointSets)
+        average.Add(Periodogram::MakeSubsetSpectra(points, classCount, size));
+    if (average.count == 0)
+        return;
+
+    std::vector<std::vector<float>> radials;
+    std::vector<std::vector<float>> anisotropies;
+    std::vector<std::string> names;
+    for (int i = 0; i < subsetCount; ++i)
     {
-        for (int classIndex = 0; classIndex < numClasses; ++classIndex)
-            pattern[numClasses - classIndex - 1] = ((1 << classIndex) & (imageIndex + 1)) ? '1' : '0';
+        char fileName[1024];
+        sprintf(fileName, "%s_periodogram.%s.png", baseFileName, ClassSubsetString(i, classCount).data());
+        Periodogram::WriteImage(fileName, average.spectra[i], 2.0f);
 
-        char fileName[1204];
-        sprintf(fileName, fileNamePattern, pattern.data());
+        radials.push_back(Periodogram::RadialAverage(average.spectra[i]));
+        anisotropies.push_back(Periodogram::Anisotropy(average.spectra[i]));
+        names.push_back(ClassSubsetString(i, classCount).data());
+    }
+
+    char fileName[1024];
+    sprintf(fileName, "%s_periodogram.csv", baseFileName);
+    Periodogram::WriteRadialCSV(fileName, radials, names);
+    sprintf(fileName, "%s_periodogram.png", baseFileName);
+    Periodogram::WritePlot(fileName, radials, 512, 256);
+    sprintf(fileName, "%s_anisotropy.csv", baseFileName);
+    Periodogram::WriteRadialCSV(fileName, anisotropies, names);
+    sprintf(fileName, "%s_anisotropy.png", baseFileName);
+    Periodogram::WritePlot(fileName, anisotropies, 512, 256);
+
+    float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+    printf("%s: periodograms of %i point sets in %0.2f seconds\n", baseFileName, average.count, seconds);
+}
+
+// The analysis command: "analyze <baseFileName> <point files...>" averages the spectra of the point sets in the files,
+// which are text files like paperdata/*.txt, or .pts files like the ones the sample sinks write.
+int Analyze(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        printf("Usage: %s analyze <baseFileName> <point files...>\n", argv[0]);
+        return 1;
+    }
 
-        char buffer[1024];
-        sprintf(buffer, "python MultiDFT.py %s 10 0 5", fileName);
-        system(buffer);
+    std::vector<std::vector<Point>> pointSets;
+    for (int i = 3; i < argc; ++i)
+    {
+        size_t length = strlen(argv[i]);
+        bool isPointFile = length >= 4 && !strcmp(&argv[i][length - 4], ".pts");
+        pointSets.push_back(isPointFile ? GetPointsFromPointFile(argv[i]) : GetPointsFromTextFile(argv[i]));
+        if (pointSets.back().empty())
+        {
+            printf("Analyze(): no points read from %s\n", argv[i]);
+            return 1;
+        }
     }
+
+    DoDFTs(argv[2], pointSets);
+    DoPeriodograms(argv[2], pointSets);
+    return 0;
 }
 
 int main(int argc, char** argv)
 {
     _mkdir("out");
 
+    if (argc > 1 && !strcmp(argv[1], "analyze"))
+        return Analyze(argc, argv);
+
     // Todo: step through adaptive
     // todo: have it cakculate trial count like the other code
 
@@ -286,30 +566,87 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    // white noise vs low discrepancy candidates
+    if (false)
+    {
+        CompareCandidateSources();
+        return 0;
+    }
+
+    // Soft's exact vs fast kernel
+    if (false)
+    {
+        CompareSoftKernels();
+        return 0;
+    }
+
+    // Soft quality vs time, for the candidate policies
+    if (false)
+    {
+        CompareSoftCandidatePolicies();
+        return 0;
+    }
+
+    // The point sets of the loops below are written in the background, while the next one is made
+    OutputPipeline output;
+    AddSamplesSinks(output);
+
+    // Periodograms of every point set. The loops below write the average over their point sets with DoPeriodograms().
+    //output.EnableSink("periodogram", true);
+
+    // The point sets of a loop are kept for the DFTs of its images
+    std::vector<std::vector<Point>> pointSets;
+
     // Hard adaptive images
     // TODO: put this at the end when it's working
     if(true)
     {
         // Hard adaptive images
+        pointSets.clear();
         for (int i = 0; i < 10; ++i)
         {
+            RNGRealization() = i;
             char fileName[1024];
             sprintf(fileName, "out/HardAdaptive%i", i);
-            MakeSamplesImage(fileName, HardAdaptive::Make({ {"clouds.png", 0.001f, 0.04f}, {"clouds.png", 0.001f, 0.02f}, {"centerblob.png", 0.001f, 0.01f} }, 1024, 1024, 5000, RNGDiscreteParams));
+            PointFile::Info info;
+            pointSets.push_back(HardAdaptive::Make({ {"clouds.png", 0.001f, 0.04f}, {"clouds.png", 0.001f, 0.02f}, {"centerblob.png", 0.001f, 0.01f} }, 1024, 1024, 5000, RNGDiscreteParams, &info));
+            SubmitSamplesImage(output, fileName, pointSets.back(), RNGInfo(info));
         }
-        DoDFTs("out/HardAdaptive%%i_bw.%s.png", 3);
+        DoDFTs("out/HardAdaptive", pointSets);
+        DoPeriodograms("out/HardAdaptive", pointSets);
     }
 
 #if 0
 
     // Soft images
+    pointSets.clear();
     for (int i = 0; i < 10; ++i)
     {
+        RNGRealization() = i;
         char fileName[1024];
         sprintf(fileName, "out/Soft%i", i);
-        MakeSamplesImage(fileName, Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true));
+        PointFile::Info info;
+        pointSets.push_back(Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true, 5, &info));
+        SubmitSamplesImage(output, fileName, pointSets.back(), RNGInfo(info));
     }
-    DoDFTs("out/Soft%%i_bw.%s.png", 3);
+    DoDFTs("out/Soft", pointSets);
+    DoPeriodograms("out/Soft", pointSets);
+
+    // Soft images with candidates coming from 8 PCG streams at once
+    //BatchedRNGContinuous batchedRNG;
+    //MakeSamplesImage("out/softBatched", Soft::Make({ 100, 1000, 4000 }, batchedRNG, true));
+
+    // Soft images scored with energy rasters instead of summing Gaussians per candidate
+    //Soft::Settings rasterSettings;
+    //rasterSettings.scoring = Soft::Scoring::Raster;
+    //rasterSettings.measureRasterError = true;
+    //MakeSamplesImage("out/softRaster", Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true, rasterSettings));
+
+    // Soft images scored with energy rasters, where the large Gaussians are done with FFT convolutions
+    //Soft::Settings fftSettings;
+    //fftSettings.scoring = Soft::Scoring::FFT;
+    //fftSettings.measureRasterError = true;
+    //MakeSamplesImage("out/softFFT", Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true, fftSettings));
 
     // Soft non toroidal
     //MakeSamplesImage("out/softCF", Soft::Make({ 100, 1000, 4000 }, RNGContinuous, false));
@@ -319,41 +656,80 @@ int main(int argc, char** argv)
     //MakeSamplesImage("out/soft100x100", Soft::Make({ 100, 1000, 4000 }, RNGDiscrete<100,100>, true));
     //MakeSamplesImage("out/soft256x256", Soft::Make({ 100, 1000, 4000 }, RNGDiscrete<256, 256>, true));
 
+    // Multi class void and cluster threshold masks, and the points at a threshold
+    //VoidAndCluster::Mask mask = VoidAndCluster::Make({ 1, 10, 40 }, 256, 256, RNGDiscreteParams);
+    //VoidAndCluster::WriteImages("out/vac256", mask);
+    //MakeSamplesImage("out/vac256_10", VoidAndCluster::ToPoints(mask, 256 * 256 / 10));
+
+    // Multi class farthest point sampling, using a periodic Delaunay triangulation
+    //MakeSamplesImage("out/farthestPoint", FarthestPoint::Make({ 100, 1000, 4000 }, RNGContinuous));
+
+    // Multi class Lloyd relaxation of another generator's points
+    //MakeSamplesImage("out/softRelaxed", Relax::Lloyd(Soft::Make({ 100, 1000, 4000 }, RNGContinuous, true)));
+
+    // Gradient descent on Soft's Gaussian energy, starting from another generator's points
+    //MakeSamplesImage("out/hardOptimized", GradientDescent::Optimize(Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, RNGContinuous, true)));
+
+    // Multi class corner tiles, tiled non periodically
+    //CornerTiles::TileSet tileSet = CornerTiles::Make({ 0.04f, 0.02f, 0.01f }, 3000, 2, RNGContinuous);
+    //MakeSamplesImage("out/cornerTiles", CornerTiles::Tile(tileSet, 4, 4, GetSeed()), 1024);
+
+    // Streaming a large domain to a text file, a row of tiles at a time
+    //Streaming::MakeToTextFile("out/streamed.txt", { 0.04f, 0.02f, 0.01f }, 3000, 100, 100, RNGContinuous);
+
     // Hard images
+    pointSets.clear();
     for (int i = 0; i < 10; ++i)
     {
+        RNGRealization() = i;
         char fileName[1024];
         sprintf(fileName, "out/Hard%i", i);
-        MakeSamplesImage(fileName, Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, RNGContinuous, true));
+        PointFile::Info info;
+        pointSets.push_back(Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, RNGContinuous, true, &info));
+        SubmitSamplesImage(output, fileName, pointSets.back(), RNGInfo(info));
     }
-    DoDFTs("out/Hard%%i_bw.%s.png", 3);
+    DoDFTs("out/Hard", pointSets);
+    DoPeriodograms("out/Hard", pointSets);
 
     // Hard non toroidal
     //MakeSamplesImage("out/hardF", Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, RNGContinuous, false));
 
+    // Repairing a Hard point set after changing a radius, instead of making it again
+    //std::vector<Point> hardPoints = Hard::Make({ {0.04f}, {0.02f}, {0.01f} }, 10000, RNGContinuous, true);
+    //MakeSamplesImage("out/hardRepaired", Hard::Repair(hardPoints, { 0.04f, 0.022f, 0.01f }, 10000, RNGContinuous, true));
+
+    // Reading back the binary point file that MakeSamplesImage writes, to relax it
+    //MakeSamplesImage("out/hardRelaxed", Relax::Lloyd(GetPointsFromPointFile("out/Hard0.pts")));
+
     // Hard sets from paper
+    pointSets.clear();
     for (int i = 0; i < 10; ++i)
     {
         char fileNameSrc[1024];
         char fileNameDest[1024];
         sprintf(fileNameSrc, "paperdata/Hard%i.txt", i);
         sprintf(fileNameDest, "out/MCBNSPaperHard%i", i);
-        MakeSamplesImage(fileNameDest, GetPointsFromTextFile(fileNameSrc));
+        pointSets.push_back(GetPointsFromTextFile(fileNameSrc));
+        SubmitSamplesImage(output, fileNameDest, pointSets.back());
     }
-    DoDFTs("out/MCBNSPaperHard%%i_bw.%s.png", 3);
+    DoDFTs("out/MCBNSPaperHard", pointSets);
+    DoPeriodograms("out/MCBNSPaperHard", pointSets);
 
 #endif
 
     // Adaptive sets from paper
+    pointSets.clear();
     for (int i = 0; i < 10; ++i)
     {
         char fileNameSrc[1024];
         char fileNameDest[1024];
         sprintf(fileNameSrc, "paperdata/adaptive%i.txt", i);
         sprintf(fileNameDest, "out/MCBNSPaperAdaptive%i", i);
-        MakeSamplesImage(fileNameDest, GetPointsFromTextFile(fileNameSrc));
+        pointSets.push_back(GetPointsFromTextFile(fileNameSrc));
+        SubmitSamplesImage(output, fileNameDest, pointSets.back());
     }
-    DoDFTs("out/MCBNSPaperAdaptive%%i_bw.%s.png", 3);
+    DoDFTs("out/MCBNSPaperAdaptive", pointSets);
+    DoPeriodograms("out/MCBNSPaperAdaptive", pointSets);
 
     return 0;
 }